@@ -14,7 +14,8 @@
 #include "common/rotate.h"
 #include "common/defines.h"
 #include "common/cacheScaler.h"
-#include "common/decoders/imgDecoderFactory.h"
+#include "common/catalog.h"
+#include "common/pageCache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -76,6 +77,15 @@ void processEvent(Display *display, Window window)
         XSetForeground(display, DefaultGC(display, 0), 0x00ff0000); // red
         XDrawString(display, window, DefaultGC(display, 0), 0, current_image.height() + 20, book.bookmark().currentFile.filePath.getFileName().c_str(), book.bookmark().currentFile.filePath.getFileName().size());
         break;
+    case FocusIn:
+        // Library is changed by others while the window is in background,
+        // changes are applied without rescanning it unless some were lost
+        if (!book.update()) {
+            const manga::Bookmark bookmark = book.bookmark();
+            book.setRoot(bookmark.rootDir);
+            book.goToBookmark(bookmark);
+        }
+        break;
     case KeyPress:
         KeySym const key_sum = XLookupKeysym(&ev.xkey, 0);
         if (key_sum == XK_Right)//XK_Right  - 114
@@ -95,11 +105,25 @@ void processEvent(Display *display, Window window)
 
 int main(int argc, char **argv)
 {
-    img::DecoderFactory::getInstance().setDecodeMode(img::DecodeIntoGray);
+    img::DecodeOptions decode_options;
+    decode_options.mode = img::DecodeIntoGray;
+    book.setDecodeOptions(decode_options);
 
     //book.setRoot(fs::FilePath("/home/hsilgos/Dropbox/Projects/pocketmanga/test/resources/valid", false));
+    book.setAsyncLoading(true);
+    book.setLazyScan(true);
+    manga::PageCache::instance().setLimit(64 * 1024 * 1024);
+    book.setPageCache(&manga::PageCache::instance());
+    manga::Catalog catalog;
+    const char *home = getenv("HOME");
+    const fs::FilePath catalog_file(std::string(home ? home : "/tmp") + "/.pocketmanga.catalog", true);
+    catalog.load(catalog_file);
+    book.setCatalog(&catalog);
+    book.setWatching(true);
     book.setRoot(fs::FilePath("/home/hsilgos/Dropbox/apictures", false));
     book.incrementPosition();
+    book.preload();
+    catalog.save(catalog_file);
 
     current_image = book.currentImage();
 
@@ -115,7 +139,7 @@ int main(int argc, char **argv)
 
     UpdateCurrentImage(display);
 
-    XSelectInput(display, window, ButtonPressMask|ExposureMask|KeyPressMask);
+    XSelectInput(display, window, ButtonPressMask|ExposureMask|KeyPressMask|FocusChangeMask);
     XMapWindow(display, window);
     while(1)
     {
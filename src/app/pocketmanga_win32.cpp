@@ -165,7 +165,9 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
 int main() {
   //book_.setRoot(fs::FilePath("i:\\tmp", false));
-  img::DecoderFactory::getInstance().setAlignment(sizeof(DWORD));
+  img::DecodeOptions decode_options;
+  decode_options.alignment = sizeof(DWORD);
+  book_.setDecodeOptions(decode_options);
   //img::DecoderFactory::getInstance().setDesiredBytePerPixel(1);
   book_.setRoot(fs::FilePath("e:/pocketbook/pocketmanga/test/resources", false));
   //manga::CacheScaler* scaler = new manga::CacheScaler(600, 800);
@@ -1,4 +1,6 @@
 #include "common/iArchive.h"
+#include "common/archives/7zArchive.h"
+#include "common/mappedFile.h"
 
 #define ENV_HAVE_WCTYPE_H
 
@@ -28,6 +30,7 @@
 #include "Windows/PropVariantConv.h"
 
 #include "7zip/Common/FileStreams.h"
+#include "7zip/Common/StreamObjects.h"
 #include "7zip/Archive/IArchive.h"
 
 #include "7zip/IPassword.h"
@@ -35,11 +38,25 @@
 
 #include "7zip/UI/Common/OpenArchive.h"
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 STDAPI CreateArchiver(const GUID *clsid, const GUID *iid, void **outObject);
 
 namespace {
+// Decoded items of solid block kept for following requests
+const size_t SolidCacheLimit = 32 * 1024 * 1024;
+// Item which is extracted alone
+const UInt64 NoBlock = ~UInt64(0);
+const UInt32 NoItem = 0xFFFFFFFF;
+// Threads decoding independent blocks, 0 is number of cores
+std::atomic<size_t> g_threads(0);
+
 DEFINE_GUID(CLSID_CFormat7z,
   0x23170F69, 0x40C1, 0x278A, 0x10, 0x00, 0x00, 0x01, 0x10, 0x07, 0x00, 0x00);
 
@@ -108,6 +125,59 @@ STDMETHODIMP CArchiveOpenCallback::CryptoGetTextPassword(BSTR *password) {
   return S_OK;
 }
 
+// Writes extracted item straight into ByteArray. Buffer is allocated from
+// size of the item, when size is unknown it grows up to max size.
+class ByteArrayOutStream:
+  public ISequentialOutStream,
+  public CMyUnknownImp
+{
+public:
+  MY_UNKNOWN_IMP
+
+  ByteArrayOutStream(tools::ByteArray& data, size_t size, size_t max_size)
+    : data_(data), buffer_(0), capacity_(size), max_size_(max_size), written_(0) {
+    if (capacity_)
+      buffer_ = data_.askBuffer(capacity_);
+  }
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+
+  size_t written() const {
+    return written_;
+  }
+
+private:
+  tools::ByteArray& data_;
+  tools::ByteArray::ByteType* buffer_;
+  size_t capacity_;
+  size_t max_size_;
+  size_t written_;
+};
+
+STDMETHODIMP ByteArrayOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+
+  if (size > capacity_ - written_) {
+    if (size > max_size_ - written_)
+      return E_FAIL;
+
+    capacity_ = std::min(std::max(written_ + size, 2 * capacity_), max_size_);
+    buffer_ = data_.askBuffer(capacity_);
+  }
+
+  memcpy(buffer_ + written_, data, size);
+  written_ += size;
+  if (processedSize)
+    *processedSize = size;
+
+  return S_OK;
+}
+
+// Extracts items into ByteArrays. Required items are always extracted,
+// the others are kept while they fit into the limit, items which precede
+// the required ones get a quarter of it.
 class CArchiveExtractCallback:
   public IArchiveExtractCallback,
   public ICryptoGetTextPassword,
@@ -116,6 +186,20 @@ class CArchiveExtractCallback:
 public:
   MY_UNKNOWN_IMP1(ICryptoGetTextPassword)
 
+  typedef std::map<UInt32, tools::ByteArray> Items;
+
+  CArchiveExtractCallback(IInArchive *archive, size_t max_size, size_t limit)
+    : _archive(archive), _maxSize(max_size), _limit(limit), _kept(0), _keptBehind(0),
+      _current(NoItem), _currentRequired(false), _currentSize(0), _knownSize(false) {}
+
+  void require(UInt32 index) {
+    _required.insert(index);
+  }
+
+  Items& items() {
+    return _items;
+  }
+
   // IProgress
   STDMETHOD(SetTotal)(UInt64 size);
   STDMETHOD(SetCompleted)(const UInt64 *completeValue);
@@ -129,45 +213,22 @@ public:
   STDMETHOD(CryptoGetTextPassword)(BSTR *aPassword);
 
 private:
-  CMyComPtr<IInArchive> _archiveHandler;
-  FString _directoryPath;  // Output directory
-  UString _filePath;       // name inside arcvhive
-  FString _diskFilePath;   // full path to file on disk
-  bool _extractMode;
-  struct CProcessedFileInfo
-  {
-    FILETIME MTime;
-    UInt32 Attrib;
-    bool isDir;
-    bool AttribDefined;
-    bool MTimeDefined;
-  } _processedFileInfo;
-
-  COutFileStream *_outFileStreamSpec;
-  CMyComPtr<ISequentialOutStream> _outFileStream;
-
-  CObjectVector<NWindows::NFile::NDir::CDelayedSymLink> _delayedSymLinks;
-
-public:
-  void Init(IInArchive *archiveHandler, const FString &directoryPath);
-
-  HRESULT SetFinalAttribs();
-
-  UInt64 NumErrors;
-  bool PasswordIsDefined;
-  UString Password;
-
-  CArchiveExtractCallback() : PasswordIsDefined(false) {}
+  CMyComPtr<IInArchive> _archive;
+  std::set<UInt32> _required;
+  size_t _maxSize;
+  size_t _limit;
+  size_t _kept;
+  size_t _keptBehind;
+  Items _items;
+
+  UInt32 _current;
+  bool _currentRequired;
+  UInt64 _currentSize;
+  bool _knownSize;
+  ByteArrayOutStream *_currentStreamSpec;
+  CMyComPtr<ISequentialOutStream> _currentStream;
 };
 
-void CArchiveExtractCallback::Init(IInArchive *archiveHandler, const FString &directoryPath)
-{
-  /*NumErrors = 0;
-  _archiveHandler = archiveHandler;
-  _directoryPath = directoryPath;
-  NName::NormalizeDirPathPrefix(_directoryPath);*/
-}
-
 STDMETHODIMP CArchiveExtractCallback::SetTotal(UInt64 /* size */)
 {
   return S_OK;
@@ -181,323 +242,399 @@ STDMETHODIMP CArchiveExtractCallback::SetCompleted(const UInt64 * /* completeVal
 STDMETHODIMP CArchiveExtractCallback::GetStream(UInt32 index,
     ISequentialOutStream **outStream, Int32 askExtractMode)
 {
-  /**outStream = 0;
-  _outFileStream.Release();
-
-  {
-    // Get Name
-    NCOM::CPropVariant prop;
-    RINOK(_archiveHandler->GetProperty(index, kpidPath, &prop));
-
-    UString fullPath;
-    if (prop.vt == VT_EMPTY)
-      fullPath = kEmptyFileAlias;
-    else
-    {
-      if (prop.vt != VT_BSTR)
-        return E_FAIL;
-      fullPath = prop.bstrVal;
-    }
-    _filePath = fullPath;
-  }
-
+  *outStream = 0;
+  _current = NoItem;
   if (askExtractMode != NArchive::NExtract::NAskMode::kExtract)
     return S_OK;
 
-  {
-    // Get Attrib
-    NCOM::CPropVariant prop;
-    RINOK(_archiveHandler->GetProperty(index, kpidAttrib, &prop));
-    if (prop.vt == VT_EMPTY)
-    {
-      _processedFileInfo.Attrib = 0;
-      _processedFileInfo.AttribDefined = false;
-    }
-    else
-    {
-      if (prop.vt != VT_UI4)
-        return E_FAIL;
-      _processedFileInfo.Attrib = prop.ulVal;
-      _processedFileInfo.AttribDefined = true;
-    }
-  }
-
-  RINOK(IsArchiveItemFolder(_archiveHandler, index, _processedFileInfo.isDir));
-
-  {
-    // Get Modified Time
-    NCOM::CPropVariant prop;
-    RINOK(_archiveHandler->GetProperty(index, kpidMTime, &prop));
-    _processedFileInfo.MTimeDefined = false;
-    switch (prop.vt)
-    {
-      case VT_EMPTY:
-        // _processedFileInfo.MTime = _utcMTimeDefault;
-        break;
-      case VT_FILETIME:
-        _processedFileInfo.MTime = prop.filetime;
-        _processedFileInfo.MTimeDefined = true;
-        break;
-      default:
-        return E_FAIL;
-    }
+  // Nothing else fits, so the rest of the block isn't decompressed
+  const bool required = _required.count(index) != 0;
+  if (!required && _required.empty() && _kept >= _limit)
+    return E_ABORT;
 
-  }
-  {
-    // Get Size
-    NCOM::CPropVariant prop;
-    RINOK(_archiveHandler->GetProperty(index, kpidSize, &prop));
-    UInt64 newFileSize;
-    ConvertPropVariantToUInt64(prop, newFileSize);
-  }
+  NWindows::NCOM::CPropVariant prop;
+  _currentSize = 0;
+  _knownSize = S_OK == _archive->GetProperty(index, kpidSize, &prop) &&
+               ConvertPropVariantToUInt64(prop, _currentSize);
+  if (_knownSize && _currentSize > _maxSize)
+    return S_OK;
 
+  size_t capacity = _maxSize;
+  if (!required) {
+    const bool behind = !_required.empty() && index < *_required.begin();
+    const size_t used = behind ? _keptBehind : _kept;
+    const size_t limit = behind ? _limit / 4 : _limit;
+    if (used >= limit || (_knownSize && _currentSize > limit - used))
+      return S_OK;
 
-  {
-    // Create folders for file
-    int slashPos = _filePath.ReverseFind_PathSepar();
-    if (slashPos >= 0)
-      CreateComplexDir(_directoryPath + us2fs(_filePath.Left(slashPos)));
+    capacity = std::min(capacity, limit - used);
   }
 
-  FString fullProcessedPath = _directoryPath + us2fs(_filePath);
-  _diskFilePath = fullProcessedPath;
-
-  if (_processedFileInfo.isDir)
-  {
-    CreateComplexDir(fullProcessedPath);
-  }
-  else
-  {
-    NFind::CFileInfo fi;
-    if (fi.Find(fullProcessedPath))
-    {
-      if (!DeleteFileAlways(fullProcessedPath))
-      {
-        PrintError("Can not delete output file", fullProcessedPath);
-        return E_ABORT;
-      }
-    }
+  _current = index;
+  _currentRequired = required;
+  _currentStreamSpec = new ByteArrayOutStream(_items[index],
+      _knownSize ? static_cast<size_t>(_currentSize) : 0,
+      _knownSize ? static_cast<size_t>(_currentSize) : capacity);
+  _currentStream = _currentStreamSpec;
 
-    _outFileStreamSpec = new COutFileStream;
-    CMyComPtr<ISequentialOutStream> outStreamLoc(_outFileStreamSpec);
-    if (!_outFileStreamSpec->Open(fullProcessedPath, CREATE_ALWAYS))
-    {
-      PrintError("Can not open output file", fullProcessedPath);
-      return E_ABORT;
-    }
-    _outFileStream = outStreamLoc;
-    *outStream = outStreamLoc.Detach();
-  }*/
+  CMyComPtr<ISequentialOutStream> stream = _currentStream;
+  *outStream = stream.Detach();
   return S_OK;
 }
 
-STDMETHODIMP CArchiveExtractCallback::PrepareOperation(Int32 askExtractMode)
+STDMETHODIMP CArchiveExtractCallback::PrepareOperation(Int32 /* askExtractMode */)
 {
-  /*_extractMode = false;
-  switch (askExtractMode)
-  {
-    case NArchive::NExtract::NAskMode::kExtract:  _extractMode = true; break;
-  };
-  switch (askExtractMode)
-  {
-    case NArchive::NExtract::NAskMode::kExtract:  PrintString(kExtractingString); break;
-    case NArchive::NExtract::NAskMode::kTest:  PrintString(kTestingString); break;
-    case NArchive::NExtract::NAskMode::kSkip:  PrintString(kSkippingString); break;
-  };
-  PrintString(_filePath);*/
   return S_OK;
 }
 
 STDMETHODIMP CArchiveExtractCallback::SetOperationResult(Int32 operationResult)
 {
-  /*switch (operationResult)
-  {
-    case NArchive::NExtract::NOperationResult::kOK:
-      break;
-    default:
-    {
-      NumErrors++;
-      PrintString("  :  ");
-      const char *s = NULL;
-      switch (operationResult)
-      {
-        case NArchive::NExtract::NOperationResult::kUnsupportedMethod:
-          s = kUnsupportedMethod;
-          break;
-        case NArchive::NExtract::NOperationResult::kCRCError:
-          s = kCRCFailed;
-          break;
-        case NArchive::NExtract::NOperationResult::kDataError:
-          s = kDataError;
-          break;
-        case NArchive::NExtract::NOperationResult::kUnavailable:
-          s = kUnavailableData;
-          break;
-        case NArchive::NExtract::NOperationResult::kUnexpectedEnd:
-          s = kUnexpectedEnd;
-          break;
-        case NArchive::NExtract::NOperationResult::kDataAfterEnd:
-          s = kDataAfterEnd;
-          break;
-        case NArchive::NExtract::NOperationResult::kIsNotArc:
-          s = kIsNotArc;
-          break;
-        case NArchive::NExtract::NOperationResult::kHeadersError:
-          s = kHeadersError;
-          break;
-      }
-      if (s)
-      {
-        PrintString("Error : ");
-        PrintString(s);
-      }
-      else
-      {
-        char temp[16];
-        ConvertUInt32ToString(operationResult, temp);
-        PrintString("Error #");
-        PrintString(temp);
-      }
-    }
+  if (NoItem == _current)
+    return S_OK;
+
+  const size_t written = _currentStreamSpec->written();
+  _currentStream.Release();
+
+  if (NArchive::NExtract::NOperationResult::kOK != operationResult ||
+      (_knownSize && written != _currentSize)) {
+    _items.erase(_current);
+  } else {
+    // Buffer of item with unknown size is larger than the item
+    _items[_current].resize(written);
+    if (_currentRequired)
+      _required.erase(_current);
+    else if (!_required.empty() && _current < *_required.begin())
+      _keptBehind += written;
+    else
+      _kept += written;
   }
 
-  if (_outFileStream)
-  {
-    if (_processedFileInfo.MTimeDefined)
-      _outFileStreamSpec->SetMTime(&_processedFileInfo.MTime);
-    RINOK(_outFileStreamSpec->Close());
-  }
-  _outFileStream.Release();
-  if (_extractMode && _processedFileInfo.AttribDefined)
-    SetFileAttrib(_diskFilePath, _processedFileInfo.Attrib, &_delayedSymLinks);
-  PrintNewLine();*/
+  _current = NoItem;
   return S_OK;
 }
 
-HRESULT CArchiveExtractCallback::SetFinalAttribs()
+STDMETHODIMP CArchiveExtractCallback::CryptoGetTextPassword(BSTR * /* password */)
 {
-  HRESULT result = S_OK;
+  // Encrypted books are not supported
+  return E_ABORT;
+}
+
+// Keeps the beginning of item and stops extraction when it's taken,
+// unless items which follow are needed too
+class HeadOutStream:
+  public ISequentialOutStream,
+  public CMyUnknownImp
+{
+public:
+  MY_UNKNOWN_IMP
+
+  HeadOutStream(tools::ByteArray& data, size_t size, bool last = true)
+    : data_(data), size_(size), last_(last) {}
+
+  STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize);
+
+private:
+  tools::ByteArray& data_;
+  size_t size_;
+  bool last_;
+};
 
-  /*for (int i = 0; i != _delayedSymLinks.Size(); ++i)
-    if (!_delayedSymLinks[i].Create())
-      result = E_FAIL;
+STDMETHODIMP HeadOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize)
+{
+  const size_t part = std::min<size_t>(size, size_ - data_.getSize());
+  if (part)
+    tools::append(data_, data, part);
 
-  _delayedSymLinks.Clear();*/
+  if (processedSize)
+    *processedSize = size;
 
-  return result;
+  return data_.getSize() < size_ || !last_ ? S_OK : E_ABORT;
 }
 
-STDMETHODIMP CArchiveExtractCallback::CryptoGetTextPassword(BSTR *password)
+// Extracts the beginning of a single item
+class CHeadExtractCallback:
+  public IArchiveExtractCallback,
+  public CMyUnknownImp
 {
-  /*if (!PasswordIsDefined)
+public:
+  MY_UNKNOWN_IMP
+
+  CHeadExtractCallback(UInt32 index, size_t size)
+    : _index(index), _size(size) {}
+
+  tools::ByteArray& head() {
+    return _head;
+  }
+
+  // IProgress
+  STDMETHOD(SetTotal)(UInt64 /* size */) { return S_OK; }
+  STDMETHOD(SetCompleted)(const UInt64 * /* completeValue */) { return S_OK; }
+
+  // IArchiveExtractCallback
+  STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream **outStream, Int32 askExtractMode)
   {
-    // You can ask real password here from user
-    // Password = GetPassword(OutStream);
-    // PasswordIsDefined = true;
-    PrintError("Password is not defined");
-    return E_ABORT;
+    *outStream = 0;
+    if (askExtractMode != NArchive::NExtract::NAskMode::kExtract || index != _index)
+      return S_OK;
+
+    CMyComPtr<ISequentialOutStream> stream = new HeadOutStream(_head, _size);
+    *outStream = stream.Detach();
+    return S_OK;
   }
-  return StringToBstr(Password, password);*/
 
-  return E_ABORT;
-}
+  STDMETHOD(PrepareOperation)(Int32 /* askExtractMode */) { return S_OK; }
+  STDMETHOD(SetOperationResult)(Int32 /* resultEOperationResult */) { return S_OK; }
 
-class StdFileStream : public IInStream,
-                     public CMyUnknownImp
+private:
+  UInt32 _index;
+  size_t _size;
+  tools::ByteArray _head;
+};
+
+// Extracts the beginnings of several items in one pass
+class CHeadsExtractCallback:
+  public IArchiveExtractCallback,
+  public CMyUnknownImp
 {
 public:
-    StdFileStream(std::string const& file_path) : m_file(file_path.c_str()) {
+  MY_UNKNOWN_IMP
 
-    }
+  typedef std::map<UInt32, tools::ByteArray> Heads;
+
+  CHeadsExtractCallback(const std::vector<UInt32>& indices, size_t size)
+    : _size(size), _last(indices.empty() ? NoItem : *std::max_element(indices.begin(), indices.end()))
+  {
+    for (size_t i = 0; i < indices.size(); ++i)
+      _heads[indices[i]];
+  }
+
+  Heads& heads() {
+    return _heads;
+  }
+
+  // IProgress
+  STDMETHOD(SetTotal)(UInt64 /* size */) { return S_OK; }
+  STDMETHOD(SetCompleted)(const UInt64 * /* completeValue */) { return S_OK; }
+
+  // IArchiveExtractCallback
+  STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream **outStream, Int32 askExtractMode)
+  {
+    *outStream = 0;
+    Heads::iterator it = _heads.find(index);
+    if (askExtractMode != NArchive::NExtract::NAskMode::kExtract || it == _heads.end())
+      return S_OK;
+
+    CMyComPtr<ISequentialOutStream> stream = new HeadOutStream(it->second, _size, index == _last);
+    *outStream = stream.Detach();
+    return S_OK;
+  }
+
+  STDMETHOD(PrepareOperation)(Int32 /* askExtractMode */) { return S_OK; }
+  STDMETHOD(SetOperationResult)(Int32 /* resultEOperationResult */) { return S_OK; }
 
 private:
-    MY_QUERYINTERFACE_BEGIN2(IInStream)
-    //MY_QUERYINTERFACE_ENTRY(IStreamGetSize)
-    MY_QUERYINTERFACE_END
-    MY_ADDREF_RELEASE
-
-    STDMETHOD(Read)(void *data, UInt32 size, UInt32 *processedSize)
-    {
-        m_file.read(reinterpret_cast<char*>(data), size);
-        if (processedSize)
-            *processedSize = m_file.gcount();
-        return m_file.good() ? S_OK : S_FALSE;
-    }
+  size_t _size;
+  UInt32 _last;
+  Heads _heads;
+};
+
+// Formats and codecs are linked statically, so they are loaded once for
+// the process and are only read by archives afterwards
+class SharedCodecs {
+public:
+  static SharedCodecs& instance() {
+    static SharedCodecs codecs;
+    return codecs;
+  }
 
-    STDMETHOD(Seek)(Int64 offset, UInt32 seekOrigin, UInt64 *newPosition)
-    {
-        // m_file.seekg()
-        switch (seekOrigin) {
-        case STREAM_SEEK_SET:
-            m_file.seekg(offset, std::ifstream::beg);
-            break;
-        case STREAM_SEEK_CUR:
-            m_file.seekg(offset, std::ifstream::cur);
-            break;
-        case STREAM_SEEK_END:
-            m_file.seekg(offset, std::ifstream::end);
-            break;
-        default:
-            return S_FALSE;
-        }
-
-        if (newPosition)
-            *newPosition = m_file.tellg();
-
-        return m_file.good() ? S_OK : S_FALSE;
+  CCodecs& codecs() {
+    return *m_codecs;
+  }
+
+  CObjectVector<COpenType> openTypes(const std::string& extension) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Types::iterator it = m_types.find(extension);
+    if (it == m_types.end()) {
+      CObjectVector<COpenType> types;
+      std::wstring l_ext(extension.begin(), extension.end());
+      ParseOpenTypes(*m_codecs, l_ext.c_str(), types);
+      it = m_types.insert(Types::value_type(extension, types)).first;
     }
 
-    std::ifstream m_file;
-};
+    return it->second;
+  }
+
+private:
+  SharedCodecs() : m_codecs(new CCodecs) {
+    m_codecsRef = m_codecs;
+    m_codecs->Load();
+  }
+
+  typedef std::map<std::string, CObjectVector<COpenType> > Types;
 
+  CCodecs* m_codecs;
+  CMyComPtr<IUnknown> m_codecsRef;
+  std::mutex m_mutex;
+  Types m_types;
+};
 }
 
 namespace archive {
 class SevenZipArchive : public IArchive {
 public:
-  SevenZipArchive(const std::string& extension) : m_extension(extension) {
+  SevenZipArchive(const std::string& extension)
+    : m_data(0), m_size(0), m_extension(extension), m_coderThreads(0), m_solid(false) {
+  }
+
+  ~SevenZipArchive() {
+    close();
   }
 
 private:
   bool open(const std::string& fileName) {
-    COpenOptions op;
+    close();
 
-    CCodecs *codecs = new CCodecs;
-    m_codecsRef = codecs;
+    // Mapped file is read with no system calls
+    if (m_mapped.open(fileName) && m_mapped.isMapped())
+      return openFrom(m_mapped.data(), m_mapped.size(), fileName);
 
-    m_openCallback = new COpenCallbackImp;
+    m_mapped.close();
+    return openFrom(0, 0, fileName);
+  }
 
-    codecs->Load();
+  bool openMemory(const tools::ByteArray& data, const std::string& name) {
+    close();
+    m_buffer = data;
+    return !m_buffer.isEmpty() && openFrom(m_buffer.getData(), m_buffer.getSize(), name);
+  }
+
+  // Data outlives the archive, file is read by its name without data
+  bool openFrom(const unsigned char* data, size_t size, const std::string& fileName) {
+    COpenOptions op;
+
+    m_openCallback = new COpenCallbackImp;
 
     // #ifndef _SFX
     CObjectVector<CProperty> props;
     op.props = &props;
     // #endif
-    op.codecs = codecs;
+    op.codecs = &SharedCodecs::instance().codecs();
     op.callback = m_openCallback;
     //op.types = &types2;
     CIntVector excludedFormats;
     op.excludedFormats = &excludedFormats;
     //op.stdInMode = options.StdInMode;
-    //StdFileStream* memory_stream = new StdFileStream(fileName);
-    //CMyComPtr<IInStream> stream;
-    //stream = memory_stream;
+    CMyComPtr<IInStream> stream;
+    if (data) {
+      CBufInStream* memory_stream = new CBufInStream;
+      stream = memory_stream;
+      memory_stream->Init(data, size);
+      op.stream = stream;
+    }
     UString pathUnicode;
     ConvertUTF8ToUnicode(fileName.c_str(), pathUnicode);
-    // op.stream = stream;
     op.filePath = pathUnicode;
-    CObjectVector<COpenType> types;
-    std::wstring l_ext(m_extension.begin(), m_extension.end());
-    ParseOpenTypes(*codecs, l_ext.c_str(), types);
+    CObjectVector<COpenType> types = SharedCodecs::instance().openTypes(m_extension);
     op.types = &types;
 
     HRESULT result = m_arcLink.Open(op);
-    return result == S_OK;
+    if (result != S_OK) {
+      close();
+      return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_path = fileName;
+    m_coderThreads = 0;
+    setCoderThreads(sevenZipThreads());
+    return true;
+  }
+
+  // Coders which decode on several threads, like bzip2, use them. The
+  // property is not known to every handler, so result is ignored.
+  void setCoderThreads(size_t count) {
+    if (count == m_coderThreads)
+      return;
+
+    m_coderThreads = count;
+    CMyComPtr<ISetProperties> set_properties;
+    m_arcLink.GetArchive()->QueryInterface(IID_ISetProperties, (void **)&set_properties);
+    if (set_properties) {
+      const wchar_t* names[] = { L"mt" };
+      NWindows::NCOM::CPropVariant values[1];
+      values[0] = static_cast<UInt32>(count);
+      set_properties->SetProperties(names, values, 1);
+    }
   }
 
   void close() {
+      for (size_t i = 0; i < m_workers.size(); ++i)
+        delete m_workers[i];
+
+      m_workers.clear();
       m_arcLink.Close();
-      m_codecsRef.Release();
+      m_items.clear();
+      m_blocks.clear();
+      m_solidCache.clear();
+      m_mapped.close();
+      m_buffer.reset();
+      m_data = 0;
+      m_size = 0;
+  }
+
+  void buildIndex() {
+    const CArc* arc = m_arcLink.GetArc();
+    if (!m_items.empty() || !arc)
+      return;
+
+    NWindows::NCOM::CPropVariant solid;
+    m_solid = S_OK == arc->Archive->GetArchiveProperty(kpidSolid, &solid) &&
+              VT_BOOL == solid.vt && VARIANT_FALSE != solid.boolVal;
+
+    UInt32 items_count = 0;
+    arc->Archive->GetNumberOfItems(&items_count);
+    m_blocks.assign(items_count, NoBlock);
+    CReadArcItem archive_item;
+    for (UInt32 i = 0; i < items_count; ++i) {
+      arc->GetItem(i, archive_item);
+      AString pathUtf8;
+      ConvertUnicodeToUTF8(archive_item.Path, pathUtf8);
+      m_items[fs::FilePath(pathUtf8.Ptr(), true).getPath()] = i;
+
+      // Solid archive without blocks, like solid rar, is one block
+      NWindows::NCOM::CPropVariant block;
+      UInt64 block_index = m_solid ? 0 : NoBlock;
+      if (!archive_item.IsDir) {
+        if (S_OK == arc->Archive->GetProperty(i, kpidBlock, &block) && VT_EMPTY != block.vt)
+          ConvertPropVariantToUInt64(block, block_index);
+
+        m_blocks[i] = block_index;
+      }
+    }
+  }
+
+  bool findItem(const fs::FilePath& path, UInt32& index) {
+    buildIndex();
+    std::map<std::string, UInt32>::const_iterator it = m_items.find(path.getPath());
+    if (it == m_items.end())
+      return false;
+
+    index = it->second;
+    return true;
+  }
+
+  // Items of the same solid block are decompressed in one pass
+  void itemsToExtract(UInt32 index, std::vector<UInt32>& indices) const {
+    if (!m_solid || NoBlock == m_blocks[index]) {
+      indices.push_back(index);
+      return;
+    }
+
+    for (UInt32 i = 0; i < m_blocks.size(); ++i) {
+      if (m_blocks[i] == m_blocks[index])
+        indices.push_back(i);
+    }
   }
 
   std::vector<fs::FilePath> getFileList(bool files_only) {
@@ -522,15 +659,284 @@ private:
   }
 
   tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    tools::ByteArray data;
+    IInArchive* in_archive = m_arcLink.GetArchive();
+    UInt32 index = 0;
+    if (!in_archive || !findItem(file_in_archive, index))
+      return data;
+
+    CArchiveExtractCallback::Items::iterator cached = m_solidCache.find(index);
+    if (cached != m_solidCache.end()) {
+      if (cached->second.getSize() <= max_size)
+        data = cached->second;
+
+      m_solidCache.erase(cached);
+      return data;
+    }
+
+    // Too large item is rejected before anything is decompressed
+    NWindows::NCOM::CPropVariant prop;
+    UInt64 size = 0;
+    if (S_OK == in_archive->GetProperty(index, kpidSize, &prop) &&
+        ConvertPropVariantToUInt64(prop, size) && size > max_size)
+      return data;
+
+    std::vector<UInt32> indices;
+    itemsToExtract(index, indices);
+
+    CArchiveExtractCallback* callback_spec =
+      new CArchiveExtractCallback(in_archive, max_size, indices.size() > 1 ? SolidCacheLimit : 0);
+    CMyComPtr<IArchiveExtractCallback> callback(callback_spec);
+    callback_spec->require(index);
+
+    // Extraction is aborted when the cache is full
+    in_archive->Extract(&indices[0], static_cast<UInt32>(indices.size()), 0, callback);
+
+    CArchiveExtractCallback::Items& items = callback_spec->items();
+    CArchiveExtractCallback::Items::iterator it = items.find(index);
+    if (it != items.end()) {
+      data = it->second;
+      items.erase(it);
+    }
+
+    m_solidCache.swap(items);
+    return data;
+  }
+
+  // Preceding items of solid block are still decompressed, the rest of
+  // the block isn't
+  tools::ByteArray getFileHead(const fs::FilePath& file_in_archive, size_t size) {
+    IInArchive* in_archive = m_arcLink.GetArchive();
+    UInt32 index = 0;
+    if (!in_archive || !findItem(file_in_archive, index) || !size)
+      return tools::ByteArray();
+
+    CArchiveExtractCallback::Items::const_iterator cached = m_solidCache.find(index);
+    if (cached != m_solidCache.end())
+      return cached->second.copyPart(0, size);
+
+    CHeadExtractCallback* callback_spec = new CHeadExtractCallback(index, size);
+    CMyComPtr<IArchiveExtractCallback> callback(callback_spec);
+    in_archive->Extract(&index, 1, 0, callback);
+    return callback_spec->head();
+  }
+
+  // Decoded items of solid block take up to SolidCacheLimit
+  void releaseCaches() {
+    m_solidCache.clear();
+  }
+
+  // Items of solid block are decoded once for all heads, item which is
+  // extracted alone stops decoding at the end of its head
+  std::vector<tools::ByteArray> getFileHeads(const std::vector<fs::FilePath>& files, size_t size) {
+    std::vector<tools::ByteArray> result(files.size());
+    IInArchive* in_archive = m_arcLink.GetArchive();
+    if (!in_archive || !size)
+      return result;
+
+    std::vector<UInt32> wanted(files.size(), NoItem);
+    std::vector<UInt32> indices;
+    for (size_t i = 0; i < files.size(); ++i) {
+      UInt32 index = 0;
+      if (!findItem(files[i], index))
+        continue;
+
+      CArchiveExtractCallback::Items::const_iterator cached = m_solidCache.find(index);
+      if (cached != m_solidCache.end()) {
+        result[i] = cached->second.copyPart(0, size);
+        continue;
+      }
+
+      // Block of non-solid archive has one item
+      if (!m_solid || NoBlock == m_blocks[index]) {
+        result[i] = getFileHead(files[i], size);
+        continue;
+      }
+
+      wanted[i] = index;
+      indices.push_back(index);
+    }
+
+    if (indices.empty())
+      return result;
+
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    CHeadsExtractCallback* callback_spec = new CHeadsExtractCallback(indices, size);
+    CMyComPtr<IArchiveExtractCallback> callback(callback_spec);
+    in_archive->Extract(&indices[0], static_cast<UInt32>(indices.size()), 0, callback);
+
+    CHeadsExtractCallback::Heads& heads = callback_spec->heads();
+    for (size_t i = 0; i < files.size(); ++i) {
+      CHeadsExtractCallback::Heads::const_iterator it = heads.find(wanted[i]);
+      if (it != heads.end())
+        result[i] = it->second;
+    }
+
+    return result;
+  }
+
+  std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+    std::vector<tools::ByteArray> result(files.size());
+    IInArchive* in_archive = m_arcLink.GetArchive();
+    if (!in_archive)
+      return result;
+
+    std::vector<UInt32> wanted(files.size(), NoItem);
+    std::vector<UInt32> indices;
+    for (size_t i = 0; i < files.size(); ++i) {
+      UInt32 index = 0;
+      if (!findItem(files[i], index))
+        continue;
+
+      CArchiveExtractCallback::Items::iterator cached = m_solidCache.find(index);
+      if (cached != m_solidCache.end()) {
+        if (cached->second.getSize() <= max_size)
+          result[i] = cached->second;
+
+        m_solidCache.erase(cached);
+        continue;
+      }
+
+      wanted[i] = index;
+      indices.push_back(index);
+    }
+
+    if (indices.empty())
+      return result;
+
+    // One pass over the archive in its own order
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+    CArchiveExtractCallback::Items items;
+    extractParallel(indices, max_size, items);
+
+    for (size_t i = 0; i < files.size(); ++i) {
+      CArchiveExtractCallback::Items::const_iterator it = items.find(wanted[i]);
+      if (it != items.end())
+        result[i] = it->second;
+    }
+
+    return result;
+  }
+
+  static void extract(IInArchive* in_archive, const std::vector<UInt32>& indices, size_t max_size,
+                      CArchiveExtractCallback::Items& items) {
+    CArchiveExtractCallback* callback_spec = new CArchiveExtractCallback(in_archive, max_size, 0);
+    CMyComPtr<IArchiveExtractCallback> callback(callback_spec);
+    for (size_t i = 0; i < indices.size(); ++i)
+      callback_spec->require(indices[i]);
+
+    in_archive->Extract(&indices[0], static_cast<UInt32>(indices.size()), 0, callback);
+    items.swap(callback_spec->items());
+  }
+
+  static void extractBy(SevenZipArchive* archive, const std::vector<UInt32>* indices,
+                        size_t max_size, CArchiveExtractCallback::Items* items) {
+    extract(archive->m_arcLink.GetArchive(), *indices, max_size, *items);
+  }
+
+  // Archive can't be read from several threads, so every other thread
+  // has its own one, they are opened once and kept until archive is
+  // closed. Returns how many threads can decode, this one included.
+  size_t openWorkers(size_t threads) {
+    while (m_workers.size() + 1 < threads) {
+      std::auto_ptr<SevenZipArchive> worker(new SevenZipArchive(m_extension));
+      if (!worker->openFrom(m_data, m_size, m_path))
+        break;
+
+      // Threads are taken by blocks already
+      worker->setCoderThreads(1);
+      m_workers.push_back(worker.release());
+    }
+
+    return std::min(threads, m_workers.size() + 1);
+  }
+
+  // Blocks are decoded one after another by a single Extract(), so
+  // independent blocks are spread between threads. Items which aren't
+  // in blocks are extracted by this thread.
+  void extractParallel(const std::vector<UInt32>& indices, size_t max_size, CArchiveExtractCallback::Items& items) {
+    buildIndex();
+    std::vector<UInt32> loose;
+    std::vector<std::vector<UInt32> > blocks;
+    for (size_t i = 0; i < indices.size(); ++i) {
+      const UInt32 index = indices[i];
+      if (NoBlock == m_blocks[index]) {
+        loose.push_back(index);
+        continue;
+      }
+
+      if (blocks.empty() || m_blocks[index] != m_blocks[blocks.back().back()])
+        blocks.push_back(std::vector<UInt32>());
+
+      blocks.back().push_back(index);
+    }
+
+    const size_t threads = blocks.size() > 1 ? openWorkers(std::min(sevenZipThreads(), blocks.size())) : 1;
+    if (threads <= 1) {
+      extract(m_arcLink.GetArchive(), indices, max_size, items);
+      return;
+    }
+
+    // Blocks are dealt in turn, so every job keeps archive order
+    std::vector<std::vector<UInt32> > jobs(threads);
+    for (size_t i = 0; i < blocks.size(); ++i)
+      jobs[i % threads].insert(jobs[i % threads].end(), blocks[i].begin(), blocks[i].end());
+
+    jobs[0].insert(jobs[0].end(), loose.begin(), loose.end());
+    std::sort(jobs[0].begin(), jobs[0].end());
+
+    std::vector<CArchiveExtractCallback::Items> results(threads);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i)
+      workers.push_back(std::thread(&SevenZipArchive::extractBy, m_workers[i - 1], &jobs[i], max_size, &results[i]));
+
+    setCoderThreads(1);
+    extract(m_arcLink.GetArchive(), jobs[0], max_size, results[0]);
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+
+    setCoderThreads(sevenZipThreads());
+    items.swap(results[0]);
+    for (size_t i = 1; i < threads; ++i)
+      items.insert(results[i].begin(), results[i].end());
   }
 
 private:
-  CMyComPtr<IUnknown> m_codecsRef;
+  // Archive is closed before its data
+  tools::MappedFile m_mapped;
+  tools::ByteArray m_buffer;
+  // Mapped file or buffer archive is read from, null for file read by its path
+  const unsigned char* m_data;
+  size_t m_size;
   CArchiveLink m_arcLink;
+  std::string m_path;
   std::string const m_extension;
   CMyComPtr<COpenCallbackImp> m_openCallback;
+  // Archives of other threads of extractParallel()
+  std::vector<SevenZipArchive*> m_workers;
+  // Value of "mt" property, 0 when it's not set
+  size_t m_coderThreads;
+  // Path of item to its index, filled on first getFile()
+  std::map<std::string, UInt32> m_items;
+  // Block (7z folder) of every item, NoBlock when archive has no blocks
+  std::vector<UInt64> m_blocks;
+  bool m_solid;
+  CArchiveExtractCallback::Items m_solidCache;
 };
 
+void setSevenZipThreads(size_t count) {
+  g_threads = count;
+}
+
+size_t sevenZipThreads() {
+  const size_t count = g_threads;
+  return count ? count : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
 AUTO_REGISTER_ARCHIVER1("7z", SevenZipArchive, "7z");
 AUTO_REGISTER_ARCHIVER1("rar", SevenZipArchive, "rar");
 AUTO_REGISTER_ARCHIVER1("tar", SevenZipArchive, "tar");
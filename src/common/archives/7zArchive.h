@@ -1,7 +1,13 @@
 
+#include <stddef.h>
 #include <memory>
 
 namespace archive {
 class IArchive;
 std::auto_ptr<IArchive> create7ZipArchiver();
+
+// Threads used to decode 7z and other 7-Zip archives, independent blocks
+// are decoded in parallel. 0 means number of cores, which is default.
+void setSevenZipThreads(size_t count);
+size_t sevenZipThreads();
 }
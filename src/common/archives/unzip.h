@@ -314,6 +314,12 @@ extern z_off_t ZEXPORT unztell OF((unzFile file));
   Give the current position in uncompressed data
 */
 
+extern uLong ZEXPORT unzGetCurrentFileZStreamPos OF((unzFile file));
+/*
+  Give the position of compressed data of the current file in the zipfile,
+  0 if no file is opened by unzOpenCurrentFile. Valid before the first read.
+*/
+
 extern int ZEXPORT unzeof OF((unzFile file));
 /*
   return 1 if the end of file was reached, 0 elsewhere
@@ -1,23 +1,271 @@
 #include "common/iArchive.h"
+#include "common/archives/zipArchive.h"
 
 #include "common/archives/unzip.h"
 #include "common/filepath.h"
+#include "common/inputStream.h"
+#include "common/mappedFile.h"
 
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace {
 // 20 megobytes?
 //const int MaxUncomppressedFilesize = 1024 * 1024 * 20;
+
+// Threads inflating entries read together, 0 is number of cores
+std::atomic<size_t> g_threads(0);
+
+// Archive data in memory, like mapped file or nested archive
+struct MemoryView {
+  const unsigned char* data;
+  size_t size;
+};
+
+// minizip io over memory, opaque is the MemoryView
+struct MemoryStream {
+  const MemoryView* view;
+  uLong pos;
+};
+
+voidpf ZCALLBACK OpenMemory(voidpf opaque, const char* /*filename*/, int mode) {
+  const MemoryView* view = static_cast<const MemoryView*>(opaque);
+  if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ || !view->data)
+    return NULL;
+
+  MemoryStream* stream = new MemoryStream;
+  stream->view = view;
+  stream->pos = 0;
+  return stream;
+}
+
+uLong ZCALLBACK ReadMemory(voidpf /*opaque*/, voidpf stream, void* buf, uLong size) {
+  MemoryStream* memory = static_cast<MemoryStream*>(stream);
+  const size_t view_size = memory->view->size;
+  if (memory->pos >= view_size)
+    return 0;
+
+  size = std::min<uLong>(size, view_size - memory->pos);
+  memcpy(buf, memory->view->data + memory->pos, size);
+  memory->pos += size;
+  return size;
+}
+
+uLong ZCALLBACK WriteMemory(voidpf /*opaque*/, voidpf /*stream*/, const void* /*buf*/, uLong /*size*/) {
+  return 0;
+}
+
+long ZCALLBACK TellMemory(voidpf /*opaque*/, voidpf stream) {
+  return static_cast<long>(static_cast<MemoryStream*>(stream)->pos);
+}
+
+long ZCALLBACK SeekMemory(voidpf /*opaque*/, voidpf stream, uLong offset, int origin) {
+  MemoryStream* memory = static_cast<MemoryStream*>(stream);
+  uLong base = 0;
+  switch (origin) {
+  case ZLIB_FILEFUNC_SEEK_CUR:
+    base = memory->pos;
+    break;
+  case ZLIB_FILEFUNC_SEEK_END:
+    base = memory->view->size;
+    break;
+  case ZLIB_FILEFUNC_SEEK_SET:
+    break;
+  default:
+    return -1;
+  }
+
+  if (base + offset > memory->view->size)
+    return -1;
+
+  memory->pos = base + offset;
+  return 0;
+}
+
+int ZCALLBACK CloseMemory(voidpf /*opaque*/, voidpf stream) {
+  delete static_cast<MemoryStream*>(stream);
+  return 0;
+}
+
+int ZCALLBACK ErrorMemory(voidpf /*opaque*/, voidpf /*stream*/) {
+  return 0;
+}
+
+void FillMemoryFilefunc(zlib_filefunc_def& def, const MemoryView& view) {
+  def.zopen_file = OpenMemory;
+  def.zread_file = ReadMemory;
+  def.zwrite_file = WriteMemory;
+  def.ztell_file = TellMemory;
+  def.zseek_file = SeekMemory;
+  def.zclose_file = CloseMemory;
+  def.zerror_file = ErrorMemory;
+  def.opaque = const_cast<MemoryView*>(&view);
+}
+
+bool Inflate(const unsigned char* src, size_t src_size, unsigned char* dst, size_t dst_size) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  // Zip entries are raw deflate streams
+  if (Z_OK != inflateInit2(&stream, -MAX_WBITS))
+    return false;
+
+  stream.next_in = const_cast<Bytef*>(src);
+  stream.avail_in = static_cast<uInt>(src_size);
+  stream.next_out = dst;
+  stream.avail_out = static_cast<uInt>(dst_size);
+  const int result = inflate(&stream, Z_FINISH);
+  const bool done = (Z_STREAM_END == result && stream.total_out == dst_size);
+  inflateEnd(&stream);
+  return done;
+}
+
+// Inflates the beginning of entry, the rest isn't touched
+bool InflateHead(const unsigned char* src, size_t src_size, unsigned char* dst, size_t dst_size) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (Z_OK != inflateInit2(&stream, -MAX_WBITS))
+    return false;
+
+  stream.next_in = const_cast<Bytef*>(src);
+  stream.avail_in = static_cast<uInt>(src_size);
+  stream.next_out = dst;
+  stream.avail_out = static_cast<uInt>(dst_size);
+  const int result = inflate(&stream, Z_SYNC_FLUSH);
+  const bool done = (Z_OK == result || Z_STREAM_END == result) && stream.total_out == dst_size;
+  inflateEnd(&stream);
+  return done;
+}
+
+// Data which streams inflate or read at once
+const size_t StreamChunk = 64 * 1024;
+
+// Inflates entry in memory by chunks
+class InflateStream : public tools::IInputStream {
+  z_stream stream_;
+  bool opened_;
+  bool finished_;
+  uLong size_;
+  std::vector<unsigned char> buffer_;
+
+  InflateStream(const InflateStream&);
+  InflateStream& operator =(const InflateStream&);
+public:
+  InflateStream(const unsigned char* data, uLong compressed_size, uLong size)
+    : opened_(false), finished_(false), size_(size), buffer_(std::min<size_t>(size, StreamChunk)) {
+    memset(&stream_, 0, sizeof(stream_));
+    opened_ = (Z_OK == inflateInit2(&stream_, -MAX_WBITS));
+    stream_.next_in = const_cast<Bytef*>(data);
+    stream_.avail_in = static_cast<uInt>(compressed_size);
+  }
+
+  ~InflateStream() {
+    if (opened_)
+      inflateEnd(&stream_);
+  }
+
+  virtual bool next(const unsigned char*& data, size_t& size) {
+    size = 0;
+    while (!size && opened_ && !finished_ && !buffer_.empty()) {
+      stream_.next_out = &buffer_[0];
+      stream_.avail_out = static_cast<uInt>(buffer_.size());
+      const int result = inflate(&stream_, Z_NO_FLUSH);
+      finished_ = (Z_OK != result);
+      // Size of entry is checked as whole file reading does
+      if ((Z_STREAM_END != result && Z_OK != result) || stream_.total_out > size_ ||
+          (Z_STREAM_END == result && stream_.total_out != size_)) {
+        finished_ = true;
+        return false;
+      }
+
+      size = buffer_.size() - stream_.avail_out;
+    }
+
+    data = buffer_.empty() ? 0 : &buffer_[0];
+    return size != 0;
+  }
+};
+
+// Reads current file of the archive, which is closed with the stream
+class CurrentFileStream : public tools::IInputStream {
+  unzFile zip_file_;
+  uLong left_;
+  std::vector<unsigned char> buffer_;
+
+  CurrentFileStream(const CurrentFileStream&);
+  CurrentFileStream& operator =(const CurrentFileStream&);
+public:
+  CurrentFileStream(unzFile zip_file, uLong size)
+    : zip_file_(zip_file), left_(size), buffer_(std::min<size_t>(size, StreamChunk)) {}
+
+  ~CurrentFileStream() {
+    unzCloseCurrentFile(zip_file_);
+  }
+
+  virtual bool next(const unsigned char*& data, size_t& size) {
+    if (!left_)
+      return false;
+
+    const int read = unzReadCurrentFile(zip_file_, &buffer_[0], static_cast<unsigned>(std::min<size_t>(left_, buffer_.size())));
+    if (read <= 0) {
+      left_ = 0;
+      return false;
+    }
+
+    left_ -= read;
+    data = &buffer_[0];
+    size = read;
+    return true;
+  }
+};
 }
 
 namespace archive {
 class ZipArchive : public IArchive {
   unzFile zip_file_;
+  tools::MappedFile mapped_;
+  // Archive opened from memory
+  tools::ByteArray buffer_;
+  // Mapped file or buffer, empty when file is read by minizip
+  MemoryView view_;
+  // Name of entry to its position in central directory
+  typedef std::unordered_map<std::string, unz_file_pos> Positions;
+  Positions positions_;
 
   bool open(const std::string& file) {
     close();
 
+    // Without mapping file would be read into memory as a whole
+    if (mapped_.open(file) && mapped_.isMapped())
+      return openView(mapped_.data(), mapped_.size(), file);
+
+    mapped_.close();
     zip_file_ = unzOpen(file.c_str());
+    return zip_file_ != NULL;
+  }
+
+  bool openMemory(const tools::ByteArray& data, const std::string& name) {
+    close();
+    buffer_ = data;
+    return openView(buffer_.getData(), buffer_.getSize(), name);
+  }
+
+  bool openView(const unsigned char* data, size_t size, const std::string& name) {
+    view_.data = data;
+    view_.size = size;
+
+    zlib_filefunc_def filefunc;
+    FillMemoryFilefunc(filefunc, view_);
+    zip_file_ = unzOpen2(name.c_str(), &filefunc);
+    if (!zip_file_)
+      close();
 
     return zip_file_ != NULL;
   }
@@ -27,6 +275,11 @@ class ZipArchive : public IArchive {
       unzClose(zip_file_);
       zip_file_ = 0;
     }
+    mapped_.close();
+    buffer_.reset();
+    view_.data = 0;
+    view_.size = 0;
+    positions_.clear();
   }
 
   bool isDirectory(const std::string& path) const {
@@ -44,6 +297,7 @@ class ZipArchive : public IArchive {
 
   std::vector<fs::FilePath> getFileList(bool files_only) {
     std::vector<fs::FilePath> list;
+    positions_.clear();
     int result = unzGoToFirstFile(zip_file_);
 
     const int MaxFileName = 1024;
@@ -52,6 +306,10 @@ class ZipArchive : public IArchive {
       unz_file_info file_info = {0};
       unzGetCurrentFileInfo(zip_file_, &file_info, buffer, MaxFileName, NULL, 0, NULL, 0);
 
+      unz_file_pos pos;
+      if (UNZ_OK == unzGetFilePos(zip_file_, &pos))
+        positions_.insert(Positions::value_type(buffer, pos));
+
       fs::FilePath path = createFilepath(buffer);
 
       if (!path.empty() && (!path.isDirectory() || !files_only))
@@ -63,42 +321,253 @@ class ZipArchive : public IArchive {
     return list;
   }
 
-  tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) {
-    tools::ByteArray data;
-    if (UNZ_OK != unzLocateFile(zip_file_, file_in_archive.getPath().c_str(), 1))
-      return data;
+  // Goes to entry without walking central directory, which
+  // unzLocateFile() does on every call
+  bool locate(const fs::FilePath& file_in_archive) {
+    if (positions_.empty() && zip_file_)
+      getFileList(true);
+
+    Positions::iterator it = positions_.find(file_in_archive.getPath());
+    return it != positions_.end() && UNZ_OK == unzGoToFilePos(zip_file_, &it->second);
+  }
 
+  // Compressed data of entry inside mapped file or buffer
+  struct MappedEntry {
+    const unsigned char* data;
+    uLong compressed_size;
+    uLong size;
+    uLong method;
+  };
+
+  enum Source {
+    NoData,
+    Mapped,
+    Streamed
+  };
+
+  // Mapped entry is decoded without the handle, streamed one is left
+  // opened for readStreamed()
+  Source openCurrentFile(size_t max_size, MappedEntry& entry) {
     if (UNZ_OK != unzOpenCurrentFile(zip_file_))
-      return data;
+      return NoData;
 
     // read length
     unz_file_info file_info = {0};
-    if (UNZ_OK != unzGetCurrentFileInfo(zip_file_, &file_info, NULL, 0, NULL, 0, NULL, 0)) {
+    if (UNZ_OK != unzGetCurrentFileInfo(zip_file_, &file_info, NULL, 0, NULL, 0, NULL, 0) ||
+        file_info.uncompressed_size > max_size) {
       unzCloseCurrentFile(zip_file_);
-      return data;
+      return NoData;
     }
 
-    if (file_info.uncompressed_size > max_size) {
+    entry.size = file_info.uncompressed_size;
+    entry.compressed_size = file_info.compressed_size;
+    entry.method = file_info.compression_method;
+
+    // Entries are decoded right from memory, without minizip buffers
+    const uLong offset = unzGetCurrentFileZStreamPos(zip_file_);
+    const bool encrypted = (0 != (file_info.flag & 1));
+    const bool stored = (0 == entry.method && entry.compressed_size == entry.size);
+    if (view_.data && offset && !encrypted && entry.size && (stored || Z_DEFLATED == entry.method) &&
+        offset <= view_.size && entry.compressed_size <= view_.size - offset) {
+      entry.data = view_.data + offset;
       unzCloseCurrentFile(zip_file_);
-      return data;
+      return Mapped;
     }
 
-    void* buff_ptr = data.askBuffer(file_info.uncompressed_size);
+    return Streamed;
+  }
+
+  tools::ByteArray readStreamed(uLong size) {
+    tools::ByteArray data;
+    void* buff_ptr = data.askBuffer(size);
     const int total_read = unzReadCurrentFile(zip_file_, buff_ptr, data.getLength());
-    if (static_cast<uLong>(total_read) != file_info.uncompressed_size)
+    if (static_cast<uLong>(total_read) != size)
       data.reset();
 
     unzCloseCurrentFile(zip_file_);
     return data;
   }
 
+  static void decode(const MappedEntry& entry, tools::ByteArray& data) {
+    unsigned char* buffer = data.askBuffer(entry.size);
+    if (Z_DEFLATED != entry.method)
+      memcpy(buffer, entry.data, entry.size);
+    else if (!Inflate(entry.data, entry.compressed_size, buffer, entry.size))
+      data.reset();
+  }
+
+  static void decodeNext(const std::vector<MappedEntry>* entries, std::vector<tools::ByteArray>* result,
+                         std::atomic<size_t>* next) {
+    for (size_t i = (*next)++; i < entries->size(); i = (*next)++)
+      decode((*entries)[i], (*result)[i]);
+  }
+
+  // Inflating takes much longer than locating entries, so located
+  // entries are inflated on several threads
+  static void decodeParallel(const std::vector<MappedEntry>& entries, std::vector<tools::ByteArray>& result) {
+    size_t deflated = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (Z_DEFLATED == entries[i].method)
+        ++deflated;
+    }
+
+    result.resize(entries.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    const size_t threads = std::min(zipThreads(), deflated);
+    for (size_t i = 1; i < threads; ++i)
+      workers.push_back(std::thread(&ZipArchive::decodeNext, &entries, &result, &next));
+
+    decodeNext(&entries, &result, &next);
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+  }
+
+  tools::ByteArray readCurrentFile(size_t max_size) {
+    tools::ByteArray data;
+    MappedEntry entry;
+    switch (openCurrentFile(max_size, entry)) {
+    case Mapped:
+      decode(entry, data);
+      break;
+    case Streamed:
+      data = readStreamed(entry.size);
+      break;
+    case NoData:
+      break;
+    }
+
+    return data;
+  }
+
+  tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    if (!locate(file_in_archive))
+      return tools::ByteArray();
+
+    return readCurrentFile(max_size);
+  }
+
+  // Nothing is decompressed before it's read
+  std::auto_ptr<tools::IInputStream> openFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    std::auto_ptr<tools::IInputStream> stream;
+    if (!locate(file_in_archive))
+      return stream;
+
+    MappedEntry entry;
+    switch (openCurrentFile(max_size, entry)) {
+    case Mapped:
+      if (Z_DEFLATED == entry.method)
+        stream.reset(new InflateStream(entry.data, entry.compressed_size, entry.size));
+      else
+        stream.reset(new tools::MemoryInputStream(entry.data, entry.size));
+      break;
+    case Streamed:
+      stream.reset(new CurrentFileStream(zip_file_, entry.size));
+      break;
+    case NoData:
+      break;
+    }
+
+    return stream;
+  }
+
+  tools::ByteArray getFileHead(const fs::FilePath& file_in_archive, size_t size) {
+    tools::ByteArray data;
+    if (!size || !locate(file_in_archive))
+      return data;
+
+    MappedEntry entry;
+    switch (openCurrentFile(std::numeric_limits<size_t>::max(), entry)) {
+    case Mapped: {
+      const size_t head_size = std::min<size_t>(size, entry.size);
+      unsigned char* buffer = data.askBuffer(head_size);
+      if (Z_DEFLATED != entry.method)
+        memcpy(buffer, entry.data, head_size);
+      else if (!InflateHead(entry.data, entry.compressed_size, buffer, head_size))
+        data.reset();
+      break;
+    }
+    case Streamed:
+      data = readStreamed(std::min<uLong>(size, entry.size));
+      break;
+    case NoData:
+      break;
+    }
+
+    return data;
+  }
+
+  static bool isBefore(const std::pair<uLong, size_t>& left, const std::pair<uLong, size_t>& right) {
+    return left.first < right.first;
+  }
+
+  // Files are located in order of archive and are decoded in parallel
+  std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+    std::vector<tools::ByteArray> list(files.size());
+    if (positions_.empty() && zip_file_)
+      getFileList(true);
+
+    std::vector<std::pair<uLong, size_t> > order;
+    for (size_t i = 0; i < files.size(); ++i) {
+      Positions::const_iterator it = positions_.find(files[i].getPath());
+      if (it != positions_.end())
+        order.push_back(std::make_pair(it->second.num_of_file, i));
+    }
+    std::stable_sort(order.begin(), order.end(), isBefore);
+
+    std::vector<MappedEntry> entries;
+    std::vector<size_t> targets;
+    for (size_t i = 0; i < order.size(); ++i) {
+      if ((i > 0 && order[i].first == order[i - 1].first) || !locate(files[order[i].second]))
+        continue;
+
+      MappedEntry entry;
+      switch (openCurrentFile(max_size, entry)) {
+      case Mapped:
+        entries.push_back(entry);
+        targets.push_back(order[i].second);
+        break;
+      case Streamed:
+        list[order[i].second] = readStreamed(entry.size);
+        break;
+      case NoData:
+        break;
+      }
+    }
+
+    std::vector<tools::ByteArray> decoded;
+    decodeParallel(entries, decoded);
+    for (size_t i = 0; i < targets.size(); ++i)
+      list[targets[i]] = decoded[i];
+
+    // Same file requested several times
+    for (size_t i = 1; i < order.size(); ++i) {
+      if (order[i].first == order[i - 1].first)
+        list[order[i].second] = list[order[i - 1].second];
+    }
+
+    return list;
+  }
+
   ~ZipArchive() {
     close();
   }
 public:
   ZipArchive()
-    : zip_file_(0) {}
+    : zip_file_(0) {
+    view_.data = 0;
+    view_.size = 0;
+  }
 };
 
+void setZipThreads(size_t count) {
+  g_threads = count;
+}
+
+size_t zipThreads() {
+  const size_t count = g_threads;
+  return count ? count : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
 AUTO_REGISTER_ARCHIVER("zip", ZipArchive);
 }
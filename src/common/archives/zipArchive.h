@@ -1,5 +1,14 @@
 
+#include <stddef.h>
 #include <memory>
+
+namespace archive {
+// Threads inflating zip entries which are read together by getFiles().
+// 0 means number of cores, which is default.
+void setZipThreads(size_t count);
+size_t zipThreads();
+}
+
 /*
 namespace archive {
 class IArchive;
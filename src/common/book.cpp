@@ -2,11 +2,21 @@
 
 #include "filemanager.h"
 
+#include "catalog.h"
+#include "diskCache.h"
 #include "iArchive.h"
+#include "pageCache.h"
+#include "decoders/imgDecoderFactory.h"
 
 #include "defines.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <assert.h>
 
 // Recursively find all subdirectories and folders
@@ -19,66 +29,103 @@
 
 namespace {
 const int MaxFilesize   = 1024 * 1024 * 20;
+// Files of archive read in one pass with the current one
+const size_t ArchivePrefetch = 4;
+// Closed archives kept open by explorer
+const size_t ArchivePoolSize = 4;
 const size_t ArchiveJustOpened = std::numeric_limits<size_t>::max();
 const size_t FileNotSpecified = std::numeric_limits<size_t>::max();
 
-struct CmpForLevel {
-  const fs::FilePath& entry;
-  const size_t level;
-  CmpForLevel(const fs::FilePath& entry, size_t level)
-    : entry(entry), level(level) {}
+size_t FindFirstFileFrom(const std::vector<fs::FilePath>& files, size_t current_file) {
+  assert(current_file < files.size());
+  const fs::FilePath& current = files[current_file];
+  for (size_t i = current_file; i > 0; --i) {
+    if (!HaveSameDirectory(files[i], current))
+      return i + 1;
+  }
+
+  return HaveSameDirectory(files[0], current) ? 0 : 1;
+}
+
+bool IsDirectory(const fs::FilePath& path) {
+  return path.isDirectory();
+}
+
+// Pages decoded with different options are different pages for caches
+std::string DecodingKey(const img::DecodeOptions& options) {
+  std::ostringstream key;
+  key << options.mode << ' ' << options.alignment << ' '
+      << options.targetSize.width << 'x' << options.targetSize.height << ' '
+      << options.region.x << ',' << options.region.y << ' '
+      << options.region.width << 'x' << options.region.height;
+  return key.str();
+}
 
-  CmpForLevel(const CmpForLevel& other)
-    : entry(other.entry), level(other.level) {}
+// Archive listed in catalog, real archive is opened when a file is read
+class CatalogArchive : public archive::IArchive {
+public:
+  explicit CatalogArchive(const fs::FilePath& path)
+    : path_(path) {}
 
-  bool operator ()(const fs::FilePath& first) {
-    return first.startsWith(entry, level, true);
+  virtual bool open(const std::string& file) {
+    path_ = fs::FilePath(file, true);
+    archive_.reset();
+    return true;
   }
-private:
 
-  CmpForLevel& operator =(const CmpForLevel&);
-};
+  virtual void close() {
+    archive_.reset();
+  }
 
-bool FindEntryInList(const std::vector<fs::FilePath>& files,
-                     const fs::FilePath& entry,
-                     //size_t &first_file_inDir,
-                     size_t& file_position) {
-  const size_t max_level = entry.getDirLevel();
-  std::vector<fs::FilePath>::const_iterator itFirst =
-    std::find_if(files.begin(), files.end(), CmpForLevel(entry, max_level));
+  virtual std::vector<fs::FilePath> getFileList(bool /*files_only*/) {
+    // Explorer takes list from catalog
+    return std::vector<fs::FilePath>();
+  }
 
-  if (files.end() == itFirst)
-    return false;
+  virtual tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    if (!archive_.get())
+      archive_.reset(archive::recognize(path_));
 
-  if (entry.isDirectory()) {
-    file_position = itFirst - files.begin();
-  } else {
-    std::vector<fs::FilePath>::const_iterator itCurrent =
-      std::find_if(
-        itFirst,
-        files.end(),
-        CmpForLevel(entry, entry.getLevel()));
+    return archive_.get() ? archive_->getFile(file_in_archive, max_size) : tools::ByteArray::empty;
+  }
 
-    if (files.end() == itCurrent)
-      return false;
+  virtual std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+    if (!archive_.get())
+      archive_.reset(archive::recognize(path_));
 
-    file_position = itCurrent - files.begin();
+    return archive_.get() ? archive_->getFiles(files, max_size) : std::vector<tools::ByteArray>(files.size());
   }
 
-  //first_file_inDir = itFirst - files.begin();
-  return true;
-}
+  virtual std::auto_ptr<tools::IInputStream> openFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    if (!archive_.get())
+      archive_.reset(archive::recognize(path_));
 
-size_t FindFirstFileFrom(const std::vector<fs::FilePath>& files, size_t current_file) {
-  assert(current_file < files.size());
-  const fs::FilePath& current = files[current_file];
-  for (size_t i = current_file; i > 0; --i) {
-    if (!HaveSameDirectory(files[i], current))
-      return i + 1;
+    return archive_.get() ? archive_->openFile(file_in_archive, max_size) : std::auto_ptr<tools::IInputStream>();
   }
 
-  return HaveSameDirectory(files[0], current) ? 0 : 1;
-}
+  virtual tools::ByteArray getFileHead(const fs::FilePath& file_in_archive, size_t size) {
+    if (!archive_.get())
+      archive_.reset(archive::recognize(path_));
+
+    return archive_.get() ? archive_->getFileHead(file_in_archive, size) : tools::ByteArray::empty;
+  }
+
+  virtual std::vector<tools::ByteArray> getFileHeads(const std::vector<fs::FilePath>& files, size_t size) {
+    if (!archive_.get())
+      archive_.reset(archive::recognize(path_));
+
+    return archive_.get() ? archive_->getFileHeads(files, size) : std::vector<tools::ByteArray>(files.size());
+  }
+
+  virtual void releaseCaches() {
+    if (archive_.get())
+      archive_->releaseCaches();
+  }
+
+private:
+  fs::FilePath path_;
+  std::auto_ptr<archive::IArchive> archive_;
+};
 
 /*
    /folder1/file1
@@ -164,8 +211,102 @@ void FixUpFileTreeForTest(std::vector<fs::FilePath>& files, const fs::FilePath&
 
 //////////////////////////////////////////////////////////////////////////
 
+void BookExplorer::EntryIndex::build(const FileList& files) {
+  first_.clear();
+  first_.reserve(files.size() * 2);
+
+  std::string key;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const fs::FilePath& file = files[i];
+
+    // Position is kept only for the first entry with the key
+    key.clear();
+    first_.insert(std::make_pair(key, i));
+    for (size_t level = 0; level < file.getLevel(); ++level) {
+      key += '/';
+      key += file.getName(level);
+      first_.insert(std::make_pair(key, i));
+    }
+  }
+}
+
+void BookExplorer::EntryIndex::clear() {
+  first_.clear();
+}
+
+bool BookExplorer::EntryIndex::find(const fs::FilePath& entry, size_t& position) const {
+  std::string key;
+  for (size_t level = 0; level < entry.getLevel(); ++level) {
+    key += '/';
+    key += entry.getName(level);
+  }
+
+  const Positions::const_iterator it = first_.find(key);
+  if (first_.end() == it)
+    return false;
+
+  position = it->second;
+  return true;
+}
+
+BookExplorer::ArchivePool::ArchivePool(size_t capacity)
+  : capacity_(capacity) {}
+
+BookExplorer::ArchivePool::~ArchivePool() {
+  clear();
+}
+
+archive::IArchive* BookExplorer::ArchivePool::take(const fs::FilePath& path, time_t modified, FileList& files) {
+  for (std::list<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->path != path)
+      continue;
+
+    archive::IArchive* result = 0;
+    if (it->modified == modified) {
+      result = it->archive;
+      files.swap(it->files);
+    } else {
+      delete it->archive;
+    }
+
+    entries_.erase(it);
+    return result;
+  }
+
+  return 0;
+}
+
+void BookExplorer::ArchivePool::put(const fs::FilePath& path, time_t modified, archive::IArchive* archive, FileList& files) {
+  if (!capacity_) {
+    delete archive;
+    return;
+  }
+
+  if (entries_.size() >= capacity_) {
+    delete entries_.back().archive;
+    entries_.pop_back();
+  }
+
+  archive->releaseCaches();
+  entries_.push_front(Entry());
+  Entry& entry = entries_.front();
+  entry.path = path;
+  entry.modified = modified;
+  entry.archive = archive;
+  entry.files.swap(files);
+}
+
+void BookExplorer::ArchivePool::clear() {
+  for (std::list<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    delete it->archive;
+
+  entries_.clear();
+}
+
 BookExplorer::BookExplorer(fs::IFileManager* file_mgr, fs::IFileManager::EntryTypes types)
-  : file_mgr_(file_mgr), find_entries_(types) {}
+  : file_mgr_(file_mgr), find_entries_(types), archive_modified_(0), archive_has_time_(false),
+    archive_pool_(ArchivePoolSize),
+    lazy_scan_(false), catalog_(0), watching_(false), files_index_valid_(false), reading_backward_(false) {}
 
 // Returns filelist ascending sorted
 std::vector<PathToFile> BookExplorer::fileList() const {
@@ -210,11 +351,42 @@ std::vector<PathToFile> BookExplorer::fileList() const {
 }
 
 bool BookExplorer::setRoot(const fs::FilePath& root) {
+  closeArchive();
   root_ = root;
-  files_ = file_mgr_->getFileList(root, find_entries_, true);
+  fs_.currentFile = 0;
+
+  // Directories are watched as they are listed
+  watcher_.reset(watching_ ? file_mgr_->createWatcher() : 0);
+  if (watcher_.get() && !watcher_->watch(root))
+    watcher_.reset();
 
   const bool files_only = (fs::IFileManager::Directory != (find_entries_ & fs::IFileManager::Directory));
-  FixUpFileTree(files_, root, fs::WordNumberOrder(), files_only);
+  if (lazy_scan_) {
+    // Directories are kept to be listed later
+    files_ = listDirectory(root);
+    std::sort(files_.begin(), files_.end(), fs::WordNumberOrder());
+    if (!files_only && !files_.empty())
+      files_.insert(files_.begin(), root);
+
+    pending_.resize(files_.size());
+    for (size_t i = 0; i < files_.size(); ++i)
+      pending_[i] = files_[i].isDirectory() && files_[i] != root;
+  } else if (catalog_ || watcher_.get()) {
+    // Directory by directory, so each one is watched before it's listed
+    files_.clear();
+    listTree(root, files_);
+    if (files_only)
+      files_.erase(std::remove_if(files_.begin(), files_.end(), IsDirectory), files_.end());
+
+    FixUpFileTree(files_, root, fs::WordNumberOrder(), files_only);
+    pending_.assign(files_.size(), false);
+  } else {
+    files_ = file_mgr_->getFileList(root, find_entries_, true);
+    FixUpFileTree(files_, root, fs::WordNumberOrder(), files_only);
+    pending_.assign(files_.size(), false);
+  }
+
+  files_index_valid_ = false;
   //if( std::find(files_.begin(), files_.end(), root) == files_.end() )
   // files_.push_back(root);
 
@@ -226,16 +398,243 @@ const fs::FilePath& BookExplorer::getRoot() const {
   return root_;
 }
 
-bool BookExplorer::openArchive(const fs::FilePath& path, bool to_beginning) {
-  current_archive_.reset(archive::recognize(path));
+void BookExplorer::setLazyScan(bool enable) {
+  lazy_scan_ = enable;
+}
+
+void BookExplorer::setCatalog(Catalog* catalog) {
+  catalog_ = catalog;
+}
+
+void BookExplorer::setWatching(bool enable) {
+  watching_ = enable;
+}
+
+bool BookExplorer::update(bool& changed) {
+  std::vector<fs::FileChange> changes;
+  const bool complete = pollChanges(changes);
+  changed = applyChanges(changes);
+  return complete;
+}
+
+bool BookExplorer::pollChanges(std::vector<fs::FileChange>& changes) {
+  changes.clear();
+  if (!watcher_.get())
+    return true;
+
+  return watcher_->poll(changes);
+}
+
+bool BookExplorer::applyChanges(const std::vector<fs::FileChange>& changes) {
+  bool changed = false;
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const fs::FilePath& path = changes[i].path;
+    if (path.getLevel() <= root_.getLevel() || !path.startsWith(root_))
+      continue;
+
+    if (fs::FileChange::Created == changes[i].type)
+      changed = insertEntry(path) || changed;
+    else
+      changed = removeEntry(path) || changed;
+  }
+
+  return changed;
+}
+
+bool BookExplorer::insertEntry(const fs::FilePath& path) {
+  const bool files_only = (fs::IFileManager::Directory != (find_entries_ & fs::IFileManager::Directory));
+
+  // Entries of directory which is not listed yet are listed when it's reached
+  if (lazy_scan_ && path.getLevel() > root_.getLevel() + 1) {
+    const fs::FilePath parent = path.copy(path.getLevel() - 2);
+    size_t position = 0;
+    if (!findInFiles(parent, position) || files_[position] != parent || pending_[position])
+      return false;
+  }
+
+  FileList entries;
+  if (!path.isDirectory() || lazy_scan_ || !files_only)
+    entries.push_back(path);
 
-  if (!current_archive_.get())
+  if (path.isDirectory() && !lazy_scan_) {
+    listTree(path, entries);
+    if (files_only)
+      entries.erase(std::remove_if(entries.begin(), entries.end(), IsDirectory), entries.end());
+
+    std::sort(entries.begin(), entries.end(), fs::WordNumberOrder());
+  }
+
+  bool changed = false;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const size_t position =
+      std::lower_bound(files_.begin(), files_.end(), entries[i], fs::WordNumberOrder()) - files_.begin();
+    if (position < files_.size() && files_[position] == entries[i])
+      continue;
+
+    files_.insert(files_.begin() + position, entries[i]);
+    pending_.insert(pending_.begin() + position, lazy_scan_ && entries[i].isDirectory());
+    if (position <= fs_.currentFile && files_.size() > 1)
+      ++fs_.currentFile;
+
+    changed = true;
+  }
+
+  if (changed)
+    files_index_valid_ = false;
+
+  return changed;
+}
+
+bool BookExplorer::removeEntry(const fs::FilePath& path) {
+  size_t first = 0;
+  if (!findInFiles(path, first))
+    return false;
+
+  // Directory goes with its entries
+  size_t last = first;
+  while (last < files_.size() && files_[last].startsWith(path))
+    ++last;
+
+  if (first == last)
     return false;
 
+  files_.erase(files_.begin() + first, files_.begin() + last);
+  pending_.erase(pending_.begin() + first, pending_.begin() + last);
+  files_index_valid_ = false;
+
+  if (fs_.currentFile >= last) {
+    fs_.currentFile -= last - first;
+  } else if (fs_.currentFile >= first) {
+    closeArchive();
+    fs_.currentFile = std::min(first, files_.empty() ? 0 : files_.size() - 1);
+  }
+
+  return true;
+}
+
+size_t BookExplorer::expand(size_t position) {
+  if (position >= pending_.size() || !pending_[position])
+    return 0;
+
+  pending_[position] = false;
+
+  std::vector<fs::FilePath> entries = listDirectory(files_[position]);
+  std::sort(entries.begin(), entries.end(), fs::WordNumberOrder());
+
+  // Entries of directory follow it in sorted tree
+  files_.insert(files_.begin() + position + 1, entries.begin(), entries.end());
+  std::vector<bool> pending(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    pending[i] = entries[i].isDirectory();
+
+  pending_.insert(pending_.begin() + position + 1, pending.begin(), pending.end());
+
+  files_index_valid_ = false;
+  return entries.size();
+}
+
+void BookExplorer::expandBackward() {
+  for (;;) {
+    const size_t inserted = expand(fs_.currentFile);
+    if (!inserted)
+      return;
+
+    fs_.currentFile += inserted;
+  }
+}
+
+void BookExplorer::reveal(const fs::FilePath& path) {
+  if (!lazy_scan_)
+    return;
+
+  for (size_t level = root_.getLevel(); level + 1 < path.getLevel(); ++level) {
+    size_t position = 0;
+    if (!findInFiles(path.copy(level), position))
+      return;
+
+    expand(position);
+  }
+}
+
+bool BookExplorer::findInFiles(const fs::FilePath& entry, size_t& position) {
+  if (!files_index_valid_) {
+    files_index_.build(files_);
+    files_index_valid_ = true;
+  }
+
+  return files_index_.find(entry, position);
+}
+
+BookExplorer::FileList BookExplorer::listDirectory(const fs::FilePath& dir) const {
+  // Changes made while it's listed are reported by its watch
+  if (watcher_.get())
+    watcher_->addDirectory(dir);
+
+  time_t modified = 0;
+  const bool cataloged = catalog_ && file_mgr_->getModificationTime(dir, modified);
+
+  FileList entries;
+  if (cataloged && catalog_->findDirectory(dir, modified, entries))
+    return entries;
+
+  entries = file_mgr_->getFileList(dir, fs::IFileManager::FileAndDirectory, false);
+  if (cataloged)
+    catalog_->setDirectory(dir, modified, entries);
+
+  return entries;
+}
+
+void BookExplorer::listTree(const fs::FilePath& dir, FileList& result) const {
+  const FileList entries = listDirectory(dir);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    result.push_back(entries[i]);
+    if (entries[i].isDirectory())
+      listTree(entries[i], result);
+  }
+}
+
+bool BookExplorer::openArchive(const fs::FilePath& path, bool to_beginning) {
+  closeArchive();
   const bool files_only = (fs::IFileManager::Directory != (find_entries_ & fs::IFileManager::Directory));
-  files_in_archive_ = current_archive_->getFileList(files_only);
 
-  FixUpFileTree(files_in_archive_, fs::FilePath(), fs::WordNumberOrder(), files_only);
+  time_t modified = 0;
+  const bool has_time = file_mgr_->getModificationTime(path, modified);
+  // Pooled archive could be changed since when its time is not known
+  if (has_time)
+    current_archive_.reset(archive_pool_.take(path, modified, files_in_archive_));
+  if (!current_archive_.get()) {
+    const bool cataloged = catalog_ && has_time;
+    bool is_archive = false;
+    if (cataloged && catalog_->findArchive(path, modified, files_only, is_archive, files_in_archive_)) {
+      if (!is_archive)
+        return false;
+
+      current_archive_.reset(new CatalogArchive(path));
+    } else {
+      current_archive_.reset(archive::recognize(path));
+      if (current_archive_.get())
+        files_in_archive_ = current_archive_->getFileList(files_only);
+
+      if (cataloged)
+        catalog_->setArchive(path, modified, files_only, current_archive_.get() != 0,
+                             current_archive_.get() ? files_in_archive_ : FileList());
+    }
+
+    if (!current_archive_.get())
+      return false;
+
+    FixUpFileTree(files_in_archive_, fs::FilePath(), fs::WordNumberOrder(), files_only);
+  }
+
+  // Files read ahead survive leaving the archive for a while, like when
+  // neighbours of its first page are looked for
+  if (path != archive_path_ || !has_time || !archive_has_time_ || modified != archive_modified_)
+    prefetched_.clear();
+
+  archive_path_ = path;
+  archive_modified_ = modified;
+  archive_has_time_ = has_time;
+  archive_index_.build(files_in_archive_);
 
   archive_.currentFile = to_beginning ? 0 : files_in_archive_.size() - 1;
 
@@ -248,8 +647,12 @@ bool BookExplorer::isCurrentInArchiveFile() const {
 }
 
 void BookExplorer::closeArchive() {
+  if (current_archive_.get() && archive_has_time_)
+    archive_pool_.put(archive_path_, archive_modified_, current_archive_.release(), files_in_archive_);
   current_archive_.reset();
+
   files_in_archive_.clear();
+  archive_index_.clear();
   archive_.currentFile = 0;
 }
 
@@ -266,11 +669,8 @@ bool BookExplorer::enter(const PathToFile& path) {
   if (path.filePath.isDirectory()) {
     // it's directory...
     if (current_pos.filePath != path.filePath) {
-      if (!FindEntryInList(
-            files_,
-            path.filePath,
-            //fs_.firstInCurrDir,
-            fs_.currentFile)) {
+      reveal(path.filePath);
+      if (!findInFiles(path.filePath, fs_.currentFile)) {
         return false;
       }
 
@@ -281,10 +681,8 @@ bool BookExplorer::enter(const PathToFile& path) {
   } else {
     // probably archive?
     if (current_pos.filePath != path.filePath || !current_archive_.get()) {
-      if (!FindEntryInList(
-            files_,
-            path.filePath,
-            fs_.currentFile)) {
+      reveal(path.filePath);
+      if (!findInFiles(path.filePath, fs_.currentFile)) {
         return false;
       }
 
@@ -299,10 +697,7 @@ bool BookExplorer::enter(const PathToFile& path) {
       }
     } else if (path.pathInArchive.empty()) {
       if (current_archive_.get()) {
-        if (!FindEntryInList(
-              files_in_archive_,
-              path.pathInArchive,
-              archive_.currentFile)) {
+        if (!archive_index_.find(path.pathInArchive, archive_.currentFile)) {
           return false;
         }
       }
@@ -311,10 +706,7 @@ bool BookExplorer::enter(const PathToFile& path) {
       return false;
     }
 
-    if (!FindEntryInList(
-          files_in_archive_,
-          path.pathInArchive,
-          archive_.currentFile)) {
+    if (!archive_index_.find(path.pathInArchive, archive_.currentFile)) {
       return false;
     }
 
@@ -336,6 +728,7 @@ bool BookExplorer::back() {
 }
 
 bool BookExplorer::toNextFile() {
+  reading_backward_ = false;
   for (;;) {
     if (current_archive_.get()) {
       if (files_in_archive_.empty()) {
@@ -359,6 +752,8 @@ bool BookExplorer::toNextFile() {
       if (files_.empty())
         return false;
 
+      // Entries of directory follow it
+      expand(fs_.currentFile);
       if (fs_.currentFile + 1 >= files_.size())
         return false;
 
@@ -382,6 +777,7 @@ bool BookExplorer::toNextFile() {
 }
 
 bool BookExplorer::toPreviousFile() {
+  reading_backward_ = true;
   if (files_.empty())
     return false;
 
@@ -415,6 +811,7 @@ bool BookExplorer::toPreviousFile() {
       }
 
       --fs_.currentFile;
+      expandBackward();
       const fs::FilePath& curr_entry = files_[fs_.currentFile];
 
       if (curr_entry.isDirectory())
@@ -435,6 +832,7 @@ bool BookExplorer::toPreviousFile() {
 
 bool BookExplorer::toFirstFile() {
   closeArchive();
+  reading_backward_ = false;
   fs_.currentFile = 0;
   //fs_.firstInCurrDir = 0;
   if (files_.empty())
@@ -454,10 +852,12 @@ bool BookExplorer::toFirstFile() {
 
 bool BookExplorer::toLastFile() {
   closeArchive();
+  reading_backward_ = true;
   if (files_.empty())
     return false;
 
   fs_.currentFile = files_.size() - 1;
+  expandBackward();
 
   const fs::FilePath& curr_entry = files_[fs_.currentFile];
   if (curr_entry.isDirectory())
@@ -491,7 +891,25 @@ tools::ByteArray BookExplorer::readCurrentFile() const {
     if (!files_in_archive_.empty() &&
         archive_.currentFile < files_in_archive_.size() &&
         !files_in_archive_[archive_.currentFile].isDirectory()) {
-      return current_archive_->getFile(files_in_archive_[archive_.currentFile], MaxFilesize);
+      const fs::FilePath& current = files_in_archive_[archive_.currentFile];
+      std::unordered_map<std::string, tools::ByteArray>::iterator it = prefetched_.find(current.getPath());
+      if (it != prefetched_.end()) {
+        const tools::ByteArray data = it->second;
+        prefetched_.erase(it);
+        return data;
+      }
+
+      FileList files(1, current);
+      filesToPrefetch(files);
+
+      const std::vector<tools::ByteArray> data = current_archive_->getFiles(files, MaxFilesize);
+      evictPrefetched();
+      for (size_t i = 1; i < files.size(); ++i) {
+        if (!data[i].isEmpty())
+          prefetched_[files[i].getPath()] = data[i];
+      }
+
+      return data[0];
     }
 
     return tools::ByteArray::empty;
@@ -506,60 +924,397 @@ tools::ByteArray BookExplorer::readCurrentFile() const {
   return tools::ByteArray::empty;
 }
 
+// Files which follow the current one in the direction of the last move
+// are read in the same pass over the archive, up to the first one which
+// is read already
+void BookExplorer::filesToPrefetch(FileList& files) const {
+  const size_t current = archive_.currentFile;
+  for (size_t distance = 1; distance < ArchivePrefetch; ++distance) {
+    if (reading_backward_ ? current < distance : current + distance >= files_in_archive_.size())
+      break;
+
+    const fs::FilePath& file = files_in_archive_[reading_backward_ ? current - distance : current + distance];
+    if (file.isDirectory())
+      continue;
+
+    if (prefetched_.find(file.getPath()) != prefetched_.end())
+      break;
+
+    files.push_back(file);
+  }
+}
+
+// Files read ahead are kept while they are close to the current one in
+// any direction, so turning back doesn't read them again
+void BookExplorer::evictPrefetched() const {
+  const size_t current = archive_.currentFile;
+  const size_t from = current > ArchivePrefetch ? current - ArchivePrefetch : 0;
+  const size_t to = std::min(current + ArchivePrefetch + 1, files_in_archive_.size());
+  std::unordered_map<std::string, tools::ByteArray> kept;
+  for (size_t i = from; i < to && kept.size() < prefetched_.size(); ++i) {
+    std::unordered_map<std::string, tools::ByteArray>::iterator it = prefetched_.find(files_in_archive_[i].getPath());
+    if (it != prefetched_.end())
+      kept[it->first] = it->second;
+  }
+
+  prefetched_.swap(kept);
+}
+
+void BookExplorer::readAhead() const {
+  if (!current_archive_.get() || !isCurrentInArchiveFile())
+    return;
+
+  FileList files;
+  filesToPrefetch(files);
+  if (files.empty())
+    return;
+
+  const std::vector<tools::ByteArray> data = current_archive_->getFiles(files, MaxFilesize);
+  evictPrefetched();
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (!data[i].isEmpty())
+      prefetched_[files[i].getPath()] = data[i];
+  }
+}
+
+std::auto_ptr<tools::IInputStream> BookExplorer::openCurrentFile() const {
+  if (current_archive_.get()) {
+    if (!files_in_archive_.empty() &&
+        archive_.currentFile < files_in_archive_.size() &&
+        !files_in_archive_[archive_.currentFile].isDirectory()) {
+      const fs::FilePath& current = files_in_archive_[archive_.currentFile];
+      std::unordered_map<std::string, tools::ByteArray>::iterator it = prefetched_.find(current.getPath());
+      if (it != prefetched_.end()) {
+        std::auto_ptr<tools::IInputStream> stream(new tools::ByteArrayInputStream(it->second));
+        prefetched_.erase(it);
+        return stream;
+      }
+
+      return current_archive_->openFile(current, MaxFilesize);
+    }
+
+    return std::auto_ptr<tools::IInputStream>();
+  }
+
+  const tools::ByteArray data = readCurrentFile();
+  if (data.isEmpty())
+    return std::auto_ptr<tools::IInputStream>();
+
+  return std::auto_ptr<tools::IInputStream>(new tools::ByteArrayInputStream(data));
+}
+
+bool BookExplorer::getModificationTime(const PathToFile& path, time_t& time) const {
+  return file_mgr_->getModificationTime(path.filePath, time);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// Loads neighbour images on a worker thread. Book keeps the explorer and the
+// decoders untouched while a task is running: caller either waits for the
+// task or cancels it, so only slots are shared and they are guarded by mutex.
+class Book::AsyncLoader {
+public:
+  explicit AsyncLoader(Book& book)
+    : book_(book), scratch_(book.createImageData()), busy_(false),
+      running_(Forward, PathToFile()), cancelled_(false), stop_(false) {
+    thread_ = std::thread(&AsyncLoader::run, this);
+  }
+
+  ~AsyncLoader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      tasks_.clear();
+      cancelled_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+    delete scratch_;
+  }
+
+  std::mutex& mutex() {
+    return mutex_;
+  }
+
+  ImageData& scratch() {
+    return *scratch_;
+  }
+
+  bool cancelled() const {
+    return cancelled_;
+  }
+
+  // Following methods must be called with mutex locked
+
+  void schedule(Direction direction, const PathToFile& from) {
+    if (pending(direction, from))
+      return;
+
+    tasks_.push_back(Task(direction, from));
+    cond_.notify_all();
+  }
+
+  // Drops queued tasks and cancels running one going in the other direction
+  void cancelExcept(Direction direction) {
+    for (std::deque<Task>::iterator it = tasks_.begin(); it != tasks_.end();) {
+      if (it->direction != direction)
+        it = tasks_.erase(it);
+      else
+        ++it;
+    }
+
+    if (busy_ && running_.direction != direction)
+      cancelled_ = true;
+  }
+
+  // Waits until image next to 'from' is loaded if it is queued or running,
+  // everything else is dropped.
+  void waitFor(std::unique_lock<std::mutex>& lock, Direction direction, const PathToFile& from) {
+    bool queued = false;
+    for (std::deque<Task>::iterator it = tasks_.begin(); it != tasks_.end();) {
+      if (it->direction == direction && it->from == from) {
+        queued = true;
+        ++it;
+      } else {
+        it = tasks_.erase(it);
+      }
+    }
+
+    if (busy_ && !(running_.direction == direction && running_.from == from)) {
+      if (!queued) {
+        stop(lock);
+        return;
+      }
+      cancelled_ = true;
+    }
+
+    while (pending(direction, from))
+      cond_.wait(lock);
+  }
+
+  void stop(std::unique_lock<std::mutex>& lock) {
+    tasks_.clear();
+    if (busy_)
+      cancelled_ = true;
+
+    while (busy_)
+      cond_.wait(lock);
+  }
+
+private:
+  struct Task {
+    Direction direction;
+    PathToFile from;
+
+    Task(Direction direction, const PathToFile& from)
+      : direction(direction), from(from) {}
+  };
+
+  bool pending(Direction direction, const PathToFile& from) const {
+    if (busy_ && running_.direction == direction && running_.from == from)
+      return true;
+
+    for (std::deque<Task>::const_iterator it = tasks_.begin(), itEnd = tasks_.end(); it != itEnd; ++it) {
+      if (it->direction == direction && it->from == from)
+        return true;
+    }
+
+    return false;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      while (!stop_ && tasks_.empty())
+        cond_.wait(lock);
+
+      if (stop_)
+        return;
+
+      const Task task = tasks_.front();
+      tasks_.pop_front();
+      busy_ = true;
+      running_ = task;
+      lock.unlock();
+
+      scratch_->clear();
+      const bool loaded =
+        book_.explorer_.enter(task.from) &&
+        book_.findAndLoadInto(task.direction, *scratch_);
+
+      lock.lock();
+      if (!cancelled_)
+        book_.completeLoading(task.direction, task.from, loaded, scratch_);
+
+      busy_ = false;
+      cancelled_ = false;
+      running_.from = PathToFile();
+      cond_.notify_all();
+    }
+  }
+
+  AsyncLoader(const AsyncLoader&);
+  AsyncLoader& operator =(const AsyncLoader&);
+
+  Book& book_;
+  ImageData* scratch_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Task> tasks_;
+
+  bool busy_;
+  Task running_;
+  std::atomic<bool> cancelled_;
+  bool stop_;
+
+  std::thread thread_;
+};
+
 //////////////////////////////////////////////////////////////////////////
 IBookCache::~IBookCache() {}
 
+std::string IBookCache::persistentKey() const {
+  return std::string();
+}
+
+bool IBookCache::save(tools::ByteArray& /*data*/) const {
+  return false;
+}
+
+bool IBookCache::restore(const unsigned char* /*data*/, size_t /*size*/) {
+  return false;
+}
+
 Book::Book()
-  : explorer_(fs::IFileManager::create(), fs::IFileManager::File) {}
+  : first_(0), ahead_(0), behind_(0), memory_limit_(0), page_cache_(0), disk_cache_(0),
+    own_decode_options_(false), explorer_(fs::IFileManager::create(), fs::IFileManager::File) {
+  setWindow(1, 1);
+}
 
 Book::Book(fs::IFileManager* file_mgr)
-  : explorer_(file_mgr, fs::IFileManager::File) {}
+  : first_(0), ahead_(0), behind_(0), memory_limit_(0), page_cache_(0), disk_cache_(0),
+    own_decode_options_(false), explorer_(file_mgr, fs::IFileManager::File) {
+  setWindow(1, 1);
+}
+
+Book::~Book() {
+  loader_.reset();
+  for (Window::iterator it = window_.begin(), itEnd = window_.end(); it != itEnd; ++it)
+    delete *it;
+}
 
 bool Book::setRoot(const fs::FilePath& root) {
+  stopLoading();
+  clearWindow();
   return explorer_.setRoot(root);
 }
 
+void Book::setLazyScan(bool enable) {
+  stopLoading();
+  explorer_.setLazyScan(enable);
+}
+
+void Book::setCatalog(Catalog* catalog) {
+  stopLoading();
+  explorer_.setCatalog(catalog);
+}
+
+void Book::setWatching(bool enable) {
+  stopLoading();
+  explorer_.setWatching(enable);
+}
+
+bool Book::update() {
+  std::vector<fs::FileChange> changes;
+  const bool complete = explorer_.pollChanges(changes);
+  if (changes.empty())
+    return complete;
+
+  stopLoading();
+
+  // Explorer follows current file through the changes
+  const PathToFile current_file = current().bookmark.currentFile;
+  if (!current_file.empty())
+    explorer_.enter(current_file);
+
+  if (!explorer_.applyChanges(changes)) {
+    resumeLoading();
+    return complete;
+  }
+
+  // Neighbours could be deleted or new files could appear between them
+  for (size_t i = 0; i < window_.size(); ++i) {
+    if (window_[i] != &current())
+      window_[i]->clear();
+  }
+
+  ends_[Forward] = PathToFile();
+  ends_[Backward] = PathToFile();
+
+  if (!current_file.empty() && explorer_.getCurrentPos() != current_file) {
+    current().clear();
+    if (!loadFromExplorerInto(current()) &&
+        !findAndLoadInto(Forward, current()) &&
+        explorer_.toLastFile() &&
+        !loadFromExplorerInto(current()))
+      findAndLoadInto(Backward, current());
+  }
+
+  resumeLoading();
+  return complete;
+}
+
 bool Book::toFirstFile() {
+  stopLoading();
+  clearWindow();
   if (!explorer_.toFirstFile())
     return false;
 
-  if (loadFromExplorerInto(current_))
+  if (loadFromExplorerInto(current()))
     return true;
 
-  return findAndLoadNext();
+  return findAndLoadInto(Forward, current());
 }
 
 bool Book::toLastFile() {
+  stopLoading();
+  clearWindow();
   if (!explorer_.toLastFile())
     return false;
 
-  if (loadFromExplorerInto(previous_))
+  if (loadFromExplorerInto(current()))
     return true;
 
-  return findAndLoadPrevious();
+  return findAndLoadInto(Backward, current());
 }
 
 bool Book::goToBookmark(const Bookmark& bookmark) {
-  return explorer_.setRoot(bookmark.rootDir) &&
-         explorer_.enter(bookmark.currentFile);
-}
+  stopLoading();
+  clearWindow();
+  // Rescanning the same root is the slowest part of the jump, it's done
+  // only when the file isn't in the tree scanned before
+  const bool same_root = bookmark.rootDir == explorer_.getRoot();
+  if (!same_root && !explorer_.setRoot(bookmark.rootDir))
+    return false;
 
-Bookmark Book::bookmark() const {
-  return current_.bookmark;
-}
+  if (!explorer_.enter(bookmark.currentFile)) {
+    if (!same_root || !explorer_.setRoot(bookmark.rootDir) || !explorer_.enter(bookmark.currentFile))
+      return false;
+  }
 
-void Book::ImageData::swap(ImageData& other) {
-  image.swap(other.image);
-  std::swap(bookmark.currentFile, other.bookmark.currentFile);
-  std::swap(bookmark.rootDir, other.bookmark.rootDir);
+  return loadFromExplorerInto(current());
+}
 
-  if (cache.get() && other.cache.get()) {
-    cache->swap(other.cache.get());
-  }
+Bookmark Book::bookmark() const {
+  Bookmark result = current().bookmark;
+  result.rootDir = explorer_.getRoot();
+  return result;
 }
 
 bool Book::ImageData::empty() const {
-  return image.empty();
+  // Image isn't loaded when results are restored by DiskCache
+  return bookmark.currentFile.empty();
 }
 
 void Book::ImageData::clear() {
@@ -568,61 +1323,233 @@ void Book::ImageData::clear() {
   bookmark.rootDir.clear();
 }
 
-bool Book::incrementPosition() {
-  if (current_.empty())
-    return toFirstFile();
+size_t Book::indexOf(Direction direction, size_t distance) const {
+  const size_t center = first_ + behind_;
+  const size_t index = (Forward == direction) ? center + distance : center + window_.size() - distance;
+  return index % window_.size();
+}
 
-  if (next_.empty()) {
-    if (!explorer_.enter(current_.bookmark.currentFile) ||
-        !findAndLoadNext())
-      return false;
+Book::ImageData& Book::at(Direction direction, size_t distance) const {
+  return *window_[indexOf(direction, distance)];
+}
+
+Book::ImageData& Book::current() const {
+  return at(Forward, 0);
+}
+
+size_t Book::depth(Direction direction) const {
+  return (Forward == direction) ? ahead_ : behind_;
+}
+
+void Book::rotate(Direction direction) {
+  // The farthest image behind becomes the farthest one ahead
+  if (Forward == direction) {
+    window_[first_]->clear();
+    first_ = (first_ + 1) % window_.size();
+  } else {
+    first_ = (first_ + window_.size() - 1) % window_.size();
+    window_[first_]->clear();
   }
+}
 
-  if (!next_.empty()) {
-    previous_.swap(current_);
-    current_.swap(next_);
+void Book::clearWindow() {
+  for (Window::iterator it = window_.begin(), itEnd = window_.end(); it != itEnd; ++it)
+    (*it)->clear();
 
-    next_.clear();
-    return true;
+  ends_[Forward] = PathToFile();
+  ends_[Backward] = PathToFile();
+}
+
+Book::ImageData* Book::createImageData() const {
+  std::auto_ptr<ImageData> data(new ImageData);
+  if (cache_prototype_.get())
+    data->cache.reset(cache_prototype_->clone());
+
+  return data.release();
+}
+
+void Book::setWindow(size_t ahead, size_t behind, size_t memory_limit) {
+  stopLoading();
+
+  ahead = std::max<size_t>(ahead, 1);
+  behind = std::max<size_t>(behind, 1);
+
+  Window window(ahead + behind + 1, static_cast<ImageData*>(0));
+  // Keep images which are still inside the window
+  if (!window_.empty()) {
+    for (size_t distance = 0; distance <= std::min(ahead, ahead_); ++distance)
+      std::swap(window[behind + distance], window_[indexOf(Forward, distance)]);
+
+    for (size_t distance = 1; distance <= std::min(behind, behind_); ++distance)
+      std::swap(window[behind - distance], window_[indexOf(Backward, distance)]);
   }
 
-  return false;
+  for (Window::iterator it = window_.begin(), itEnd = window_.end(); it != itEnd; ++it)
+    delete *it;
+
+  for (Window::iterator it = window.begin(), itEnd = window.end(); it != itEnd; ++it) {
+    if (!*it)
+      *it = createImageData();
+  }
+
+  window_.swap(window);
+  first_ = 0;
+  ahead_ = ahead;
+  behind_ = behind;
+  memory_limit_ = memory_limit;
+}
+
+bool Book::incrementPosition() {
+  if (current().empty())
+    return toFirstFile();
+
+  return loader_.get() ? shiftPositionAsync(Forward) : shiftPosition(Forward);
 }
 
 bool Book::decrementPosition() {
-  if (current_.empty())
+  if (current().empty())
     return toLastFile();
 
-  if (previous_.empty()) {
-    if (!explorer_.enter(current_.bookmark.currentFile) ||
-        !findAndLoadPrevious())
+  return loader_.get() ? shiftPositionAsync(Backward) : shiftPosition(Backward);
+}
+
+bool Book::shiftPosition(Direction direction) {
+  ImageData& ahead = at(direction, 1);
+
+  if (ahead.empty()) {
+    const PathToFile from = current().bookmark.currentFile;
+    if (from == ends_[direction])
       return false;
+
+    if (!explorer_.enter(from) ||
+        !findAndLoadInto(direction, ahead)) {
+      ends_[direction] = from;
+      return false;
+    }
   }
 
-  if (!previous_.empty()) {
-    next_.swap(current_);
-    current_.swap(previous_);
+  rotate(direction);
+  return true;
+}
+
+bool Book::shiftPositionAsync(Direction direction) {
+  std::unique_lock<std::mutex> lock(loader_->mutex());
+
+  loader_->cancelExcept(direction);
+  if (at(direction, 1).empty()) {
+    loader_->waitFor(lock, direction, current().bookmark.currentFile);
 
-    previous_.clear();
+    // Worker is idle here if image is still not loaded, so
+    // explorer can be used on this thread.
+    if (at(direction, 1).empty())
+      loader_->stop(lock);
+  }
+
+  if (!shiftPosition(direction))
+    return false;
+
+  scheduleLoading(direction);
+  return true;
+}
+
+void Book::stopLoading() {
+  if (loader_.get()) {
+    std::unique_lock<std::mutex> lock(loader_->mutex());
+    loader_->stop(lock);
+  }
+}
+
+void Book::resumeLoading() {
+  if (!loader_.get() || current().empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(loader_->mutex());
+  scheduleLoading(Forward);
+}
+
+bool Book::findSlotToLoad(Direction direction, size_t& distance) const {
+  for (size_t d = 1; d <= depth(direction); ++d) {
+    if (!at(direction, d).empty())
+      continue;
+
+    const ImageData& from = at(direction, d - 1);
+    if (from.empty() || from.bookmark.currentFile == ends_[direction])
+      return false;
+
+    if (d > 1 && !fitsMemoryLimit())
+      return false;
+
+    distance = d;
     return true;
   }
 
   return false;
 }
 
-bool Book::findAndLoadPrevious() {
-  while (explorer_.toPreviousFile()) {
-    if (loadFromExplorerInto(previous_))
-      return true;
+bool Book::fitsMemoryLimit() const {
+  if (!memory_limit_)
+    return true;
+
+  // Next image is expected to be not larger than the largest loaded one
+  size_t used = 0;
+  size_t largest = 0;
+  for (Window::const_iterator it = window_.begin(), itEnd = window_.end(); it != itEnd; ++it) {
+    const size_t size = img::dataSize((*it)->image);
+    used += size;
+    largest = std::max(largest, size);
   }
 
-  return false;
+  return used + largest <= memory_limit_;
+}
+
+void Book::fillWindow(Direction direction) {
+  size_t distance = 0;
+  while (findSlotToLoad(direction, distance)) {
+    const PathToFile from = at(direction, distance - 1).bookmark.currentFile;
+    if (!explorer_.enter(from) ||
+        !findAndLoadInto(direction, at(direction, distance))) {
+      ends_[direction] = from;
+      return;
+    }
+  }
+}
+
+void Book::scheduleLoading(Direction preferred) {
+  const Direction other = (Forward == preferred) ? Backward : Forward;
+
+  size_t distance = 0;
+  if (findSlotToLoad(preferred, distance))
+    loader_->schedule(preferred, at(preferred, distance - 1).bookmark.currentFile);
+
+  if (findSlotToLoad(other, distance))
+    loader_->schedule(other, at(other, distance - 1).bookmark.currentFile);
+}
+
+void Book::completeLoading(Direction direction, const PathToFile& from, bool loaded, ImageData*& image_data) {
+  // Window could be shifted while loading, look for the slot next to 'from'
+  for (size_t d = 1; d <= depth(direction); ++d) {
+    ImageData& target = at(direction, d);
+    if (!target.empty() || at(direction, d - 1).bookmark.currentFile != from)
+      continue;
+
+    if (loaded)
+      std::swap(window_[indexOf(direction, d)], image_data);
+    else
+      ends_[direction] = from;
+
+    break;
+  }
+
+  scheduleLoading(direction);
 }
 
-bool Book::findAndLoadNext() {
+bool Book::findAndLoadInto(Direction direction, ImageData& image_data) {
   // find first suitable file
-  while (explorer_.toNextFile()) {
-    if (loadFromExplorerInto(next_))
+  while (Forward == direction ? explorer_.toNextFile() : explorer_.toPreviousFile()) {
+    if (loader_.get() && loader_->cancelled())
+      return false;
+
+    if (loadFromExplorerInto(image_data))
       return true;
   }
 
@@ -631,19 +1558,59 @@ bool Book::findAndLoadNext() {
 
 bool Book::loadFromExplorerInto(ImageData& image_data) {
   PathToFile path = explorer_.getCurrentPos();
+  const img::DecodeOptions options = decodeOptions();
+
+  // Page of unknown time is cached too, it's the same while time stays unknown
+  time_t modified = 0;
+  const bool has_time = (page_cache_ || disk_cache_) && explorer_.getModificationTime(path, modified);
+  const PageCache::Key key(path, modified, DecodingKey(options));
+  if (page_cache_ && page_cache_->find(key, image_data.image, image_data.cache)) {
+    image_data.bookmark.currentFile = path;
+    return true;
+  }
+
+  const bool persistent = disk_cache_ && image_data.cache.get() && has_time;
+  if (persistent && disk_cache_->find(path, modified, key.decoding, *image_data.cache)) {
+    image_data.image.destroy();
+    image_data.bookmark.currentFile = path;
+    return true;
+  }
 
   const fs::FilePath& file =
     path.pathInArchive.empty() ? path.filePath : path.pathInArchive;
 
-  tools::ByteArray data = explorer_.readCurrentFile();
-  if (data.isEmpty())
-    return false;
+  // Page is decoded while it's decompressed, when it's not an image of its
+  // extension the other decoders get what is decompressed already with the
+  // rest of the page
+  bool loaded = false;
+  {
+    std::auto_ptr<tools::IInputStream> stream = explorer_.openCurrentFile();
+    if (!stream.get())
+      return false;
+
+    tools::RecordingInputStream recording(*stream);
+    loaded = image_data.image.load(file.getExtension(), recording, options);
+    if (!loaded) {
+      tools::ByteArray data = recording.recorded();
+      tools::append(data, tools::readAll(*stream));
+      loaded = !data.isEmpty() && image_data.image.load(file.getExtension(), data, options);
+    }
+  }
 
-  if (image_data.image.load(file.getExtension(), data)) {
-    image_data.bookmark.currentFile = explorer_.getCurrentPos();
+  // Archive is used again only when the stream is closed
+  explorer_.readAhead();
+
+  if (loaded) {
+    image_data.bookmark.currentFile = path;
     if (image_data.cache.get())
       image_data.cache->onLoaded(image_data.image);
 
+    if (persistent)
+      disk_cache_->insert(path, modified, key.decoding, *image_data.cache);
+
+    if (page_cache_)
+      page_cache_->insert(key, image_data.image, image_data.cache.get());
+
     return true;
   }
 
@@ -651,44 +1618,91 @@ bool Book::loadFromExplorerInto(ImageData& image_data) {
 }
 
 void Book::preload() {
-  if (current_.empty())
+  if (current().empty())
     toFirstFile();
 
-  if (!next_.empty() && !previous_.empty())
+  if (current().empty())
     return;
 
-  if (!current_.empty()) {
-    Bookmark curr_b_m = current_.bookmark;
-
-    if (previous_.empty()) {
-      if (explorer_.enter(curr_b_m.currentFile))
-        findAndLoadPrevious();
-    }
-
-    if (next_.empty()) {
-      if (explorer_.enter(curr_b_m.currentFile))
-        findAndLoadNext();
-    }
+  if (loader_.get()) {
+    std::lock_guard<std::mutex> lock(loader_->mutex());
+    scheduleLoading(Forward);
+    return;
   }
+
+  fillWindow(Backward);
+  fillWindow(Forward);
 }
 
 img::Image Book::currentImage() const {
-  return current_.image;
+  return current().image;
 }
 
 IBookCache* Book::currentCache() const {
-  return current_.cache.get();
+  return current().cache.get();
 }
 
 void Book::setCachePrototype(IBookCache* cache) {
-  if (cache) {
-    previous_.cache.reset(cache->clone());
-    current_.cache.reset(cache);
-    next_.cache.reset(cache->clone());
-  } else {
-    previous_.cache.reset();
-    current_.cache.reset();
-    next_.cache.reset();
+  stopLoading();
+  // Cached results were made by previous prototype
+  if (page_cache_)
+    page_cache_->clear();
+
+  cache_prototype_.reset(cache ? cache->clone() : 0);
+
+  for (Window::iterator it = window_.begin(), itEnd = window_.end(); it != itEnd; ++it)
+    (*it)->cache.reset(cache ? cache->clone() : 0);
+
+  current().cache.reset(cache);
+
+  if (loader_.get())
+    loader_->scratch().cache.reset(cache ? cache->clone() : 0);
+}
+
+void Book::setAsyncLoading(bool enable) {
+  if (enable == asyncLoading())
+    return;
+
+  if (enable)
+    loader_.reset(new AsyncLoader(*this));
+  else
+    loader_.reset();
+}
+
+void Book::setPageCache(PageCache* cache) {
+  stopLoading();
+  page_cache_ = cache;
+}
+
+void Book::setDiskCache(DiskCache* cache) {
+  stopLoading();
+  disk_cache_ = cache;
+}
+
+void Book::setDecodeOptions(const img::DecodeOptions& options) {
+  stopLoading();
+  const bool changed = DecodingKey(options) != DecodingKey(decodeOptions());
+  decode_options_ = options;
+  own_decode_options_ = true;
+  if (!changed) {
+    resumeLoading();
+    return;
   }
+
+  // Loaded pages were decoded with previous options
+  const PathToFile current_file = current().bookmark.currentFile;
+  clearWindow();
+  if (!current_file.empty() && explorer_.enter(current_file))
+    loadFromExplorerInto(current());
+
+  resumeLoading();
+}
+
+img::DecodeOptions Book::decodeOptions() const {
+  return own_decode_options_ ? decode_options_ : img::DecoderFactory::getInstance().getDefaultOptions();
+}
+
+bool Book::asyncLoading() const {
+  return loader_.get() != 0;
 }
 }
@@ -1,21 +1,28 @@
 #pragma once
 
+#include <list>
 #include <string>
 #include <memory>
 #include <vector>
 #include <ostream>
+#include <unordered_map>
 
 #include "filepath.h"
 #include "byteArray.h"
 #include "filemanager.h"
 #include "iArchive.h"
 #include "image.h"
+#include "decoders/decodeOptions.h"
 
 namespace img {
 class Image;
 }
 
 namespace manga {
+class Catalog;
+class DiskCache;
+class PageCache;
+
 void FixUpFileTreeForTest(std::vector<fs::FilePath>& files, const fs::FilePath& root);
 
 struct PathToFile {
@@ -72,6 +79,33 @@ public:
   bool setRoot(const fs::FilePath& root);
   const fs::FilePath& getRoot() const;
 
+  // When enabled setRoot() lists only the root directory, every other
+  // directory is listed when it's reached, so time to the first file
+  // doesn't depend on size of the tree. Applied on next setRoot().
+  void setLazyScan(bool enable);
+
+  // Listings of directories and archives are taken from catalog while
+  // they are up to date and are stored there otherwise, so archive is
+  // opened only when its file is read. Catalog is not owned, 0 disables
+  // it. Applied on next setRoot().
+  void setCatalog(Catalog* catalog);
+
+  // When enabled directories are watched since they are listed and
+  // update() applies their changes without rescanning. Applied on next
+  // setRoot().
+  void setWatching(bool enable);
+  // Returns false when some changes were lost and root should be set
+  // again, changed tells if the tree is changed
+  bool update(bool& changed);
+  // Takes changes from the watcher without applying them, tree isn't
+  // touched so it can be called while loader uses explorer
+  bool pollChanges(std::vector<fs::FileChange>& changes);
+  // Inserts created entries and removes deleted ones keeping the list
+  // sorted, returns true when the tree is changed. Position stays at the
+  // same entry, when it's deleted position goes to the entry which
+  // follows it.
+  bool applyChanges(const std::vector<fs::FileChange>& changes);
+
   // Enters to some directory or archive
   bool enter(const PathToFile& path);
   bool back();
@@ -84,13 +118,81 @@ public:
 
   PathToFile getCurrentPos() const;
   tools::ByteArray readCurrentFile() const;
+  // Current file of archive is decompressed while it's read, unless
+  // it was read ahead. Explorer isn't used while the stream exists.
+  std::auto_ptr<tools::IInputStream> openCurrentFile() const;
+  // Reads files of archive which follow the current one in the direction
+  // of reading in one pass, when they are not read ahead already. It's
+  // called after the stream of the current file is closed.
+  void readAhead() const;
+  // Time of the file or of the archive containing it
+  bool getModificationTime(const PathToFile& path, time_t& time) const;
 
 private:
   BookExplorer(const BookExplorer&);
   BookExplorer& operator =(const BookExplorer&);
 
+  // Finds the first entry of sorted list which starts with a path
+  // without walking the list
+  class EntryIndex {
+  public:
+    void build(const FileList& files);
+    void clear();
+    bool find(const fs::FilePath& entry, size_t& position) const;
+
+  private:
+    typedef std::unordered_map<std::string, size_t> Positions;
+    Positions first_;
+  };
+
+  // Recently closed archives with their lists, so entering the same
+  // archive again doesn't read its headers
+  class ArchivePool {
+  public:
+    explicit ArchivePool(size_t capacity);
+    ~ArchivePool();
+
+    // Moves archive and its list out of pool, archive is 0 when
+    // it's not pooled or file is modified since
+    archive::IArchive* take(const fs::FilePath& path, time_t modified, FileList& files);
+    // Takes ownership of archive and releases its caches, files are swapped
+    void put(const fs::FilePath& path, time_t modified, archive::IArchive* archive, FileList& files);
+    void clear();
+
+  private:
+    ArchivePool(const ArchivePool&);
+    ArchivePool& operator =(const ArchivePool&);
+
+    struct Entry {
+      fs::FilePath path;
+      time_t modified;
+      archive::IArchive* archive;
+      FileList files;
+    };
+
+    // Most recently closed archives are at front
+    std::list<Entry> entries_;
+    size_t capacity_;
+  };
+
+  // Lists directory at position right after it if it's not listed yet,
+  // returns number of inserted entries.
+  size_t expand(size_t position);
+  // Goes to the last entry of directory at current position
+  void expandBackward();
+  // Lists all directories on the way to the path
+  void reveal(const fs::FilePath& path);
+  bool findInFiles(const fs::FilePath& entry, size_t& position);
+  // Both use catalog when it's set and watch listed directories
+  FileList listDirectory(const fs::FilePath& dir) const;
+  void listTree(const fs::FilePath& dir, FileList& result) const;
+  bool insertEntry(const fs::FilePath& path);
+  bool removeEntry(const fs::FilePath& path);
+
   bool openArchive(const fs::FilePath& path, bool to_beginning);
   void closeArchive();
+  void filesToPrefetch(FileList& files) const;
+  void evictPrefetched() const;
   bool isCurrentInArchiveFile() const;
   //bool FindFirstSuitable()
   std::auto_ptr<fs::IFileManager> file_mgr_;
@@ -99,9 +201,29 @@ private:
 
   fs::FilePath root_;
   std::auto_ptr<archive::IArchive> current_archive_;
+  fs::FilePath archive_path_;
+  time_t archive_modified_;
+  // Archive without modification time isn't pooled
+  bool archive_has_time_;
+  ArchivePool archive_pool_;
+  // Files read ahead from archive at archive_path_, kept while explorer
+  // leaves it for a while
+  mutable std::unordered_map<std::string, tools::ByteArray> prefetched_;
 
   std::vector<fs::FilePath> files_;
   std::vector<fs::FilePath> files_in_archive_;
+  EntryIndex files_index_;
+  EntryIndex archive_index_;
+
+  bool lazy_scan_;
+  Catalog* catalog_;
+  bool watching_;
+  std::auto_ptr<fs::IFileWatcher> watcher_;
+  // Directories of files_ which are not listed yet
+  std::vector<bool> pending_;
+  bool files_index_valid_;
+  // Direction of the last move, files of archive are read ahead in it
+  bool reading_backward_;
 
   struct FileIndex {
     size_t currentFile;
@@ -123,8 +245,18 @@ public:
   virtual ~IBookCache();
 
   virtual IBookCache* clone() = 0;
+  // Unlike clone() keeps results of onLoaded()
+  virtual IBookCache* copy() const = 0;
   virtual void swap(IBookCache* other) = 0;
   virtual bool onLoaded(img::Image& image) = 0;
+  virtual size_t memoryUsage() const = 0;
+
+  // Results of onLoaded() stored by DiskCache. Results made with
+  // different settings must have different keys, empty key means
+  // results can't be stored.
+  virtual std::string persistentKey() const;
+  virtual bool save(tools::ByteArray& data) const;
+  virtual bool restore(const unsigned char* data, size_t size);
   //virtual Cache getCached(size_t id) const = 0;
 };
 
@@ -132,6 +264,7 @@ class Book {
 public:
   Book();
   explicit Book(fs::IFileManager* file_mgr);
+  ~Book();
   // Looks for next image
   bool incrementPosition();
   // Looks for previous image
@@ -149,8 +282,47 @@ public:
   bool toFirstFile();
   bool toLastFile();
 
+  // See BookExplorer::setLazyScan
+  void setLazyScan(bool enable);
+  // See BookExplorer::setCatalog
+  void setCatalog(Catalog* catalog);
+
+  // See BookExplorer::setWatching
+  void setWatching(bool enable);
+  // Applies changes of the tree, preloaded images are dropped when
+  // something is changed. Loading isn't interrupted while the watcher
+  // reports nothing, so it's cheap to call often. When current file is deleted the next one
+  // becomes current. Returns false when root should be set again.
+  bool update();
+
   void setCachePrototype(IBookCache* cache);
 
+  // When enabled previous and next images are read and decoded on
+  // a worker thread, preload() only schedules loading and returns.
+  // Disabled by default.
+  void setAsyncLoading(bool enable);
+  bool asyncLoading() const;
+
+  // Sets how many images are kept around current one. Both depths are
+  // at least 1. Images beyond the nearest ones are not preloaded when
+  // the loaded images would take more than memory_limit bytes, 0 means
+  // no limit. Default is one image ahead and one behind.
+  void setWindow(size_t ahead, size_t behind, size_t memory_limit = 0);
+
+  // Pages are taken from cache instead of being read and decoded again.
+  // Cache is not owned, 0 disables caching. Disabled by default.
+  void setPageCache(PageCache* cache);
+
+  // Results of cache prototype are stored on disk and restored when the
+  // same page is opened again, neither decoding nor onLoaded() is done
+  // then and currentImage() is empty. Cache is not owned, 0 disables it.
+  void setDiskCache(DiskCache* cache);
+
+  // Pages are decoded with these options, default ones of DecoderFactory
+  // are used until they are set
+  void setDecodeOptions(const img::DecodeOptions& options);
+  img::DecodeOptions decodeOptions() const;
+
   // Set/Get bookmark
   Bookmark bookmark() const;
   bool goToBookmark(const Bookmark& bookmark);
@@ -158,25 +330,66 @@ private:
   Book(const Book&);
   Book& operator =(const Book&);
 
+  enum Direction {
+    Forward,
+    Backward
+  };
+
+  class AsyncLoader;
+  friend class AsyncLoader;
+
   struct ImageData {
     img::Image image;
     std::auto_ptr<IBookCache> cache;
     Bookmark bookmark;
 
-    void swap(ImageData& other);
     bool empty() const;
     void clear();
   };
 
-  bool findAndLoadPrevious();
-  bool findAndLoadNext();
+  // Ring of images around current one, first_ points to the farthest
+  // image behind.
+  typedef std::vector<ImageData*> Window;
+
+  // Distance 0 is current image
+  size_t indexOf(Direction direction, size_t distance) const;
+  ImageData& at(Direction direction, size_t distance) const;
+  ImageData& current() const;
+  size_t depth(Direction direction) const;
+  void rotate(Direction direction);
+  void clearWindow();
+  ImageData* createImageData() const;
+
+  bool findSlotToLoad(Direction direction, size_t& distance) const;
+  bool fitsMemoryLimit() const;
+  void fillWindow(Direction direction);
+  void scheduleLoading(Direction preferred);
+  void completeLoading(Direction direction, const PathToFile& from, bool loaded, ImageData*& image_data);
+
+  bool findAndLoadInto(Direction direction, ImageData& data);
 
   bool loadFromExplorerInto(ImageData& data);
 
-  ImageData previous_;
-  ImageData current_;
-  ImageData next_;
+  bool shiftPosition(Direction direction);
+  bool shiftPositionAsync(Direction direction);
+  void stopLoading();
+  // Schedules loading of the window again after stopLoading()
+  void resumeLoading();
+
+  Window window_;
+  size_t first_;
+  size_t ahead_;
+  size_t behind_;
+  size_t memory_limit_;
+  // Last files in each direction, nothing is found past them
+  PathToFile ends_[2];
+  std::auto_ptr<IBookCache> cache_prototype_;
+  PageCache* page_cache_;
+  DiskCache* disk_cache_;
+  img::DecodeOptions decode_options_;
+  bool own_decode_options_;
 
   BookExplorer explorer_;
+  std::auto_ptr<AsyncLoader> loader_;
 };
 }
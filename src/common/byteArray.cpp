@@ -10,10 +10,10 @@ AtomicInt::AtomicInt(int init_value)
   : value_(init_value) {}
 
 AtomicInt::AtomicInt(const AtomicInt& other)
-  : value_(other.value_) {}
+  : value_(other.value_.load()) {}
 
 AtomicInt& AtomicInt::operator =(const AtomicInt& other) {
-  value_ = other.value_;
+  value_ = other.value_.load();
   return *this;
 }
 
@@ -21,12 +21,12 @@ int AtomicInt::getValue() const {
   return value_;
 }
 
-void AtomicInt::inc(int step) {
-  value_ += step;
+int AtomicInt::inc(int step) {
+  return value_ += step;
 }
 
-void AtomicInt::dec(int step) {
-  value_ -= step;
+int AtomicInt::dec(int step) {
+  return value_ -= step;
 }
 
 AtomicInt::operator int() const {
@@ -129,11 +129,8 @@ void ByteArray::changeTo(ByteArray::SharedData* other) {
     return;
 
   if (shared_data_) {
-    if (1 == shared_data_->ref.getValue()) {
+    if (0 == shared_data_->ref.dec())
       delete shared_data_;
-    } else {
-      shared_data_->ref.dec();
-    }
 
     shared_data_ = 0;
   }
@@ -153,7 +150,8 @@ ByteArray::SharedData* ByteArray::acquire() {
       shared_data_->buffer  = other->buffer;
 
       shared_data_->ref.inc();
-      other->ref.dec();
+      if (0 == other->ref.dec())
+        delete other;
     }
   }
   return shared_data_;
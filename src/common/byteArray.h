@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <numeric>
 #include <memory.h>
@@ -18,7 +19,7 @@
 
 namespace tools {
 class AtomicInt {
-  volatile int value_;
+  std::atomic<int> value_;
 public:
   AtomicInt(int init_value = 0);
 
@@ -27,8 +28,9 @@ public:
 
   int getValue() const;
 
-  void inc(int step = 1);
-  void dec(int step = 1);
+  // Both return new value
+  int inc(int step = 1);
+  int dec(int step = 1);
 
   operator int() const;
   AtomicInt& operator ++();
@@ -1,16 +1,42 @@
 #include "cacheScaler.h"
 
 #include <assert.h>
+#include <string.h>
+
+#include <sstream>
 
 #include "rotate.h"
 #include "scale.h"
 #include "debugUtils.h"
 
+namespace {
+// Stored before pixels of scaled image
+struct StoredHeader {
+  int orientation;
+  int representation;
+  int bounds[4];
+  int current_showing;
+  unsigned width;
+  unsigned height;
+  unsigned depth;
+  unsigned alignment;
+  unsigned reserved;
+};
+}
+
 namespace manga {
 IBookCache* CacheScaler::clone() {
   return new CacheScaler(screen_width_, screen_height_);
 }
 
+IBookCache* CacheScaler::copy() const {
+  return new CacheScaler(*this);
+}
+
+size_t CacheScaler::memoryUsage() const {
+  return img::dataSize(orig_.image) + img::dataSize(scaled_.image);
+}
+
 void CacheScaler::swap(IBookCache* other_cache) {
   CacheScaler* other =
     utils::isDebugging() ? dynamic_cast<CacheScaler*>(other_cache) : static_cast<CacheScaler*>(other_cache);
@@ -68,7 +94,9 @@ bool CacheScaler::Cache::previousBounds() {
 }
 
 bool CacheScaler::onLoaded(img::Image& image) {
-  img::toBgr(image, orig_.image);
+  // Grey image is taken as it is
+  if (!img::toBgr(image, orig_.image))
+    img::copy(image, orig_.image);
   img::toGray(orig_.image, orig_.image);
   if (orig_.image.width() < screen_width_ && orig_.image.height() < screen_height_) {
     scaled_.representation = Whole;
@@ -141,10 +169,74 @@ bool CacheScaler::onLoaded(img::Image& image) {
   return true;
 }
 
+std::string CacheScaler::persistentKey() const {
+  std::ostringstream key;
+  key << "CacheScaler " << screen_width_ << 'x' << screen_height_;
+  return key.str();
+}
+
+bool CacheScaler::save(tools::ByteArray& data) const {
+  if (scaled_.image.empty())
+    return false;
+
+  StoredHeader header;
+  header.orientation = scaled_.orientation;
+  header.representation = scaled_.representation;
+  header.bounds[0] = scaled_.bounds.x;
+  header.bounds[1] = scaled_.bounds.y;
+  header.bounds[2] = scaled_.bounds.width;
+  header.bounds[3] = scaled_.bounds.height;
+  header.current_showing = scaled_.currentShowing;
+  header.width = scaled_.image.width();
+  header.height = scaled_.image.height();
+  header.depth = scaled_.image.depth();
+  header.alignment = static_cast<unsigned>(scaled_.image.alignment());
+  header.reserved = 0;
+
+  const size_t size = img::dataSize(scaled_.image);
+  unsigned char* buffer = data.askBuffer(sizeof(header) + size);
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), scaled_.image.data(), size);
+  return true;
+}
+
+bool CacheScaler::restore(const unsigned char* data, size_t size) {
+  StoredHeader header;
+  if (size < sizeof(header))
+    return false;
+
+  memcpy(&header, data, sizeof(header));
+  if (0 == header.alignment || 2 == header.depth ||
+      !img::areValidDimentions(header.width, header.height, header.depth, header.alignment))
+    return false;
+
+  scaled_.image.create(header.width, header.height, header.depth, header.alignment);
+  const size_t image_size = img::dataSize(scaled_.image);
+  if (size - sizeof(header) != image_size)
+    return false;
+
+  memcpy(scaled_.image.data(), data + sizeof(header), image_size);
+  scaled_.orientation = static_cast<Orientation>(header.orientation);
+  scaled_.representation = static_cast<RepresentType>(header.representation);
+  scaled_.bounds = utils::Rect(header.bounds[0], header.bounds[1], header.bounds[2], header.bounds[3]);
+  scaled_.currentShowing = header.current_showing;
+
+  orig_.image.destroy();
+  return true;
+}
+
 CacheScaler::Cache& CacheScaler::scaledGrey() {
   return scaled_;
 }
 
+utils::Size CacheScaler::decodeSize() const {
+  return utils::Size(screen_height_, screen_height_);
+}
+
 CacheScaler::CacheScaler(const size_t screen_width, const size_t screen_height)
   : screen_width_(screen_width), screen_height_(screen_height) {}
+
+CacheScaler::CacheScaler(const CacheScaler& other)
+  : IBookCache(), orig_(other.orig_), scaled_(other.scaled_),
+    screen_width_(other.screen_width_), screen_height_(other.screen_height_) {}
 }
@@ -32,9 +32,15 @@ public:
   };
 
   CacheScaler(const size_t screen_width, const size_t screen_height);
+  // Images share data with other until one of them is changed
+  CacheScaler(const CacheScaler& other);
 
   Cache& scaledGrey();
 
+  // Smaller decoded page loses quality when it's scaled for the screen,
+  // page is fitted by its shorter side in any orientation
+  utils::Size decodeSize() const;
+
 private:
   CacheScaler& operator =(const CacheScaler&);
 
@@ -44,7 +50,14 @@ private:
   const size_t screen_height_;
 
   virtual IBookCache* clone();
+  virtual IBookCache* copy() const;
   virtual void swap(IBookCache* other);
   virtual bool onLoaded(img::Image& image);
+  virtual size_t memoryUsage() const;
+
+  // Only scaled image is stored
+  virtual std::string persistentKey() const;
+  virtual bool save(tools::ByteArray& data) const;
+  virtual bool restore(const unsigned char* data, size_t size);
 };
 }
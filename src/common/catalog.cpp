@@ -0,0 +1,232 @@
+#include "catalog.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mappedFile.h"
+
+namespace {
+const char Magic[4] = { 'P', 'M', 'C', 'T' };
+const unsigned Version = 1;
+
+// File starts with header followed by records, every record is followed
+// by its key and encoded entries
+struct Header {
+  char magic[4];
+  unsigned version;
+  unsigned records;
+};
+
+struct RecordHeader {
+  long long modified;
+  unsigned key_size;
+  unsigned entries_size;
+  unsigned is_archive;
+};
+
+template<class T>
+void append(std::string& data, const T& value) {
+  data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<class T>
+bool read(const unsigned char*& pos, const unsigned char* end, T& value) {
+  if (static_cast<size_t>(end - pos) < sizeof(value))
+    return false;
+
+  memcpy(&value, pos, sizeof(value));
+  pos += sizeof(value);
+  return true;
+}
+
+// Every entry is flag of directory, size of path and path
+void encode(const std::vector<fs::FilePath>& entries, std::string& data) {
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const std::string& path = entries[i].getPath();
+    append(data, static_cast<unsigned char>(entries[i].isDirectory()));
+    append(data, static_cast<unsigned>(path.size()));
+    data += path;
+  }
+}
+
+bool decode(const unsigned char* pos, size_t size, std::vector<fs::FilePath>& entries) {
+  const unsigned char* end = pos + size;
+  entries.clear();
+  while (pos != end) {
+    unsigned char is_dir = 0;
+    unsigned path_size = 0;
+    if (!read(pos, end, is_dir) || !read(pos, end, path_size) ||
+        static_cast<size_t>(end - pos) < path_size)
+      return false;
+
+    entries.push_back(fs::FilePath(std::string(reinterpret_cast<const char*>(pos), path_size), !is_dir));
+    pos += path_size;
+  }
+
+  return true;
+}
+
+std::string keyOf(char kind, const fs::FilePath& path) {
+  return kind + path.getPath();
+}
+}
+
+namespace manga {
+Catalog::Catalog() {}
+
+Catalog::~Catalog() {}
+
+bool Catalog::load(const fs::FilePath& file) {
+  std::auto_ptr<tools::MappedFile> mapped(new tools::MappedFile);
+  if (!mapped->open(file.getPath()))
+    return false;
+
+  const unsigned char* pos = mapped->data();
+  const unsigned char* end = pos + mapped->size();
+
+  Header header;
+  if (!read(pos, end, header) ||
+      0 != memcmp(header.magic, Magic, sizeof(Magic)) ||
+      Version != header.version)
+    return false;
+
+  Records records;
+  for (unsigned i = 0; i < header.records; ++i) {
+    RecordHeader record_header;
+    if (!read(pos, end, record_header) ||
+        static_cast<size_t>(end - pos) < record_header.key_size ||
+        static_cast<size_t>(end - pos) - record_header.key_size < record_header.entries_size)
+      return false;
+
+    Record& record = records[std::string(reinterpret_cast<const char*>(pos), record_header.key_size)];
+    pos += record_header.key_size;
+
+    record.modified = static_cast<time_t>(record_header.modified);
+    record.is_archive = 0 != record_header.is_archive;
+    record.encoded = pos;
+    record.encoded_size = record_header.entries_size;
+    pos += record_header.entries_size;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_.swap(records);
+  file_ = mapped;
+  return true;
+}
+
+bool Catalog::save(const fs::FilePath& file) const {
+  std::string data;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.records = static_cast<unsigned>(records_.size());
+    append(data, header);
+
+    std::string entries;
+    for (Records::const_iterator it = records_.begin(), itEnd = records_.end(); it != itEnd; ++it) {
+      const Record& record = it->second;
+      if (record.encoded)
+        entries.assign(reinterpret_cast<const char*>(record.encoded), record.encoded_size);
+      else {
+        entries.clear();
+        encode(record.entries, entries);
+      }
+
+      RecordHeader record_header;
+      record_header.modified = record.modified;
+      record_header.key_size = static_cast<unsigned>(it->first.size());
+      record_header.entries_size = static_cast<unsigned>(entries.size());
+      record_header.is_archive = record.is_archive;
+      append(data, record_header);
+      data += it->first;
+      data += entries;
+    }
+  }
+
+  // Catalog which is mapped now stays valid after rename
+  const std::string file_name = file.getPath();
+  std::ostringstream temp_name;
+  temp_name << file_name << '.' << std::this_thread::get_id() << ".tmp";
+
+  {
+    std::ofstream out(temp_name.str().c_str(), std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    if (!out) {
+      out.close();
+      remove(temp_name.str().c_str());
+      return false;
+    }
+  }
+
+  if (0 != rename(temp_name.str().c_str(), file_name.c_str())) {
+    remove(temp_name.str().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void Catalog::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  records_.clear();
+  file_.reset();
+}
+
+size_t Catalog::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return records_.size();
+}
+
+bool Catalog::findDirectory(const fs::FilePath& dir, time_t modified, FileList& entries) const {
+  bool is_archive = false;
+  return find(keyOf('d', dir), modified, is_archive, entries);
+}
+
+void Catalog::setDirectory(const fs::FilePath& dir, time_t modified, const FileList& entries) {
+  set(keyOf('d', dir), modified, false, entries);
+}
+
+bool Catalog::findArchive(const fs::FilePath& file, time_t modified, bool files_only,
+                          bool& is_archive, FileList& entries) const {
+  return find(keyOf(files_only ? 'f' : 'a', file), modified, is_archive, entries);
+}
+
+void Catalog::setArchive(const fs::FilePath& file, time_t modified, bool files_only,
+                         bool is_archive, const FileList& entries) {
+  set(keyOf(files_only ? 'f' : 'a', file), modified, is_archive, entries);
+}
+
+bool Catalog::find(const std::string& key, time_t modified, bool& is_archive, FileList& entries) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Records::const_iterator it = records_.find(key);
+  if (it == records_.end() || it->second.modified != modified)
+    return false;
+
+  const Record& record = it->second;
+  if (record.encoded) {
+    if (!decode(record.encoded, record.encoded_size, entries))
+      return false;
+  } else
+    entries = record.entries;
+
+  is_archive = record.is_archive;
+  return true;
+}
+
+void Catalog::set(const std::string& key, time_t modified, bool is_archive, const FileList& entries) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Record& record = records_[key];
+  record.modified = modified;
+  record.is_archive = is_archive;
+  record.encoded = 0;
+  record.encoded_size = 0;
+  record.entries = entries;
+}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <time.h>
+
+#include "filepath.h"
+
+namespace tools {
+class MappedFile;
+}
+
+namespace manga {
+// Listings of directories and archives of a library kept between runs.
+// Listings are keyed by full paths, so a single catalog file can serve
+// any number of roots. Listing is valid while modification time of
+// its directory or archive stays the same, so it's checked by one stat.
+// Catalog file is mapped on load() and listings are decoded only when
+// they are asked for. Methods can be called from any thread.
+class Catalog {
+public:
+  typedef std::vector<fs::FilePath> FileList;
+
+  Catalog();
+  ~Catalog();
+
+  // Replaces content of catalog with content of file
+  bool load(const fs::FilePath& file);
+  bool save(const fs::FilePath& file) const;
+  void clear();
+  // Number of listings
+  size_t size() const;
+
+  bool findDirectory(const fs::FilePath& dir, time_t modified, FileList& entries) const;
+  void setDirectory(const fs::FilePath& dir, time_t modified, const FileList& entries);
+
+  // File which isn't an archive is kept too with is_archive false, so it's
+  // not probed by archivers again
+  bool findArchive(const fs::FilePath& file, time_t modified, bool files_only,
+                   bool& is_archive, FileList& entries) const;
+  void setArchive(const fs::FilePath& file, time_t modified, bool files_only,
+                  bool is_archive, const FileList& entries);
+
+private:
+  Catalog(const Catalog&);
+  Catalog& operator =(const Catalog&);
+
+  struct Record {
+    time_t modified;
+    bool is_archive;
+    // Encoded entries in mapped file, entries are used when it's 0
+    const unsigned char* encoded;
+    size_t encoded_size;
+    FileList entries;
+
+    Record()
+      : modified(0), is_archive(false), encoded(0), encoded_size(0) {}
+  };
+
+  typedef std::unordered_map<std::string, Record> Records;
+
+  bool find(const std::string& key, time_t modified, bool& is_archive, FileList& entries) const;
+  void set(const std::string& key, time_t modified, bool is_archive, const FileList& entries);
+
+  mutable std::mutex mutex_;
+  Records records_;
+  std::auto_ptr<tools::MappedFile> file_;
+};
+}
@@ -860,6 +860,10 @@ LoadFunction GetLoadFunctionFor(const LoadImageData& data) {
 namespace img {
 class BmpDecoder : public IDecoder {
 public:
+  virtual IDecoder* clone() const {
+    return new BmpDecoder;
+  }
+
   virtual std::vector<std::string> getExts() const {
     std::vector<std::string> exts;
 
@@ -869,6 +873,16 @@ public:
     return exts;
   }
 
+  // Headers and palette are enough
+  virtual bool readSize(const tools::ByteArray& head, utils::Size& size) {
+    const HeaderParser header(head);
+    if (!header.is_valid(getAlignment()))
+      return false;
+
+    size = header.image_size();
+    return true;
+  }
+
   LoadImageData FillDataFromHeader(const HeaderParser& header) {
     const bool is_reversed = header.is_reversed();
     const utils::Size image_size = header.image_size();
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "common/decoders/decodeMode.h"
+#include "common/defines.h"
+
+namespace img {
+// Settings of a single decoding
+struct DecodeOptions {
+  DecodeMode mode;
+  // Rows of decoded image are aligned to it
+  size_t alignment;
+  // Decoders which can decode at reduced size keep the image not smaller
+  // than target, zero dimension isn't limited. Empty size is full size.
+  utils::Size targetSize;
+  // Part of decoded image which is kept, empty one keeps the whole image
+  utils::Rect region;
+
+  DecodeOptions()
+    : mode(DecodeAsIs), alignment(1) {}
+};
+}
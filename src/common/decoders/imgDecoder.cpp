@@ -1,27 +1,41 @@
 #include "imgDecoder.h"
 
+#include "common/inputStream.h"
 
 namespace img {
-IDecoder::IDecoder() : align_(1), decode_mode_(DecodeAsIs) {
+IDecoder::IDecoder() {
 }
  
 IDecoder::~IDecoder() {
 }
 
-void IDecoder::setAlignment(size_t align) {
-  align_ = align;
+bool IDecoder::decode(tools::IInputStream& encoded, img::Image& decoded) {
+  const tools::ByteArray data = tools::readAll(encoded);
+  return !data.isEmpty() && decode(data, decoded);
 }
 
-size_t IDecoder::getAlignment() const {
-  return align_;
+bool IDecoder::readSize(const tools::ByteArray&, utils::Size&) {
+  return false;
+}
+
+void IDecoder::setOptions(const DecodeOptions& options) {
+  options_ = options;
+}
+
+const DecodeOptions& IDecoder::getOptions() const {
+  return options_;
 }
 
-void IDecoder::setDecodeMode(DecodeMode mode) {
-  decode_mode_ = mode;
+size_t IDecoder::getAlignment() const {
+  return options_.alignment;
 }
 
 DecodeMode IDecoder::getDecodeMode() const {
-  return decode_mode_;
+  return options_.mode;
+}
+
+const utils::Size& IDecoder::getTargetSize() const {
+  return options_.targetSize;
 }
 
 }
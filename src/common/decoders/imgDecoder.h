@@ -3,10 +3,11 @@
 #include <vector>
 #include <string>
 
-#include "common/decoders/decodeMode.h"
+#include "common/decoders/decodeOptions.h"
 
 namespace tools {
 class ByteArray;
+class IInputStream;
 }
 
 namespace img {
@@ -16,18 +17,28 @@ class IDecoder {
 public:
   IDecoder();
   virtual ~IDecoder();
+  // New decoder of the same type. Decoder is used by one thread at a time,
+  // so factory clones it for every concurrent decoding.
+  virtual IDecoder* clone() const = 0;
   // returns preferable extensions
   virtual std::vector<std::string> getExts() const = 0;
   virtual bool decode(const tools::ByteArray& encoded, img::Image& decoded) = 0;
+  // Decodes data while it's being read. Default one reads the whole
+  // stream first, stream is consumed in any case.
+  virtual bool decode(tools::IInputStream& encoded, img::Image& decoded);
+  // Dimensions from the header only, head is the beginning of encoded data
+  // and may be cut anywhere. False when it's too short or isn't supported.
+  virtual bool readSize(const tools::ByteArray& head, utils::Size& size);
 
-  void setAlignment(size_t align);
-  size_t getAlignment() const;
+  // Options of the next decoding, see DecodeOptions
+  void setOptions(const DecodeOptions& options);
+  const DecodeOptions& getOptions() const;
 
-  void setDecodeMode(DecodeMode mode);
+  size_t getAlignment() const;
   DecodeMode getDecodeMode() const;
+  const utils::Size& getTargetSize() const;
 
 private:
-  size_t align_;
-  DecodeMode decode_mode_;
+  DecodeOptions options_;
 };
 }
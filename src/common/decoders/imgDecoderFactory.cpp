@@ -1,16 +1,80 @@
 #include "imgDecoderFactory.h"
 
-#include <vector>
+#include <string.h>
+
+#include <algorithm>
 
 #include "common/image.h"
+#include "common/inputStream.h"
 #include "common/decoders/imgDecoder.h"
 
+namespace {
+// Keeps region of decoded image, false when it's outside the image and
+// then nothing is kept
+bool CropTo(const utils::Rect& region, img::Image& image) {
+  if (!region.width || !region.height)
+    return true;
+
+  const utils::Rect rect = utils::restrictBy(region, utils::Rect(0, 0, image.width(), image.height()));
+  if (!rect.width || !rect.height) {
+    image.destroy();
+    return false;
+  }
+
+  img::Image cropped(rect.width, rect.height, image.depth(), image.alignment());
+  const size_t row_size = cropped.scanline(false);
+  const size_t padding = cropped.scanline(true) - row_size;
+  for (img::Image::SizeType y = 0; y < rect.height; ++y) {
+    unsigned char* dst = cropped.data() + y * cropped.scanline(true);
+    memcpy(dst, image.data() + (rect.y + y) * image.scanline(true) + rect.x * image.depth(), row_size);
+    memset(dst + row_size, 0, padding);
+  }
+
+  image.swap(cropped);
+  return true;
+}
+}
+
 namespace img {
-DecoderFactory::DecoderFactory() : align_(1), decode_mode_(DecodeAsIs) {
+// Decoder which is taken for a single call and given back afterwards
+class DecoderFactory::Lease {
+public:
+  Lease(const DecoderFactory& factory, const IDecoder* prototype, const DecodeOptions& options)
+    : factory_(factory), prototype_(prototype), decoder_(factory.take(prototype)) {
+    decoder_->setOptions(options);
+  }
+
+  ~Lease() {
+    factory_.giveBack(prototype_, decoder_);
+  }
+
+  IDecoder* operator ->() const {
+    return decoder_;
+  }
+
+private:
+  Lease(const Lease&);
+  Lease& operator =(const Lease&);
+
+  const DecoderFactory& factory_;
+  const IDecoder* prototype_;
+  IDecoder* decoder_;
+};
+
+DecoderFactory::DecoderFactory() {
+}
+
+DecoderFactory::~DecoderFactory() {
+  IdleDecoders::iterator it = idle_.begin(), itEnd = idle_.end();
+  for (; it != itEnd; ++it) {
+    for (size_t i = 0; i < it->second.size(); ++i)
+      delete it->second[i];
+  }
 }
 
 void DecoderFactory::registerDecoder(img::IDecoder* decoder) {
   if (decoder) {
+    std::lock_guard<std::mutex> lock(mutex_);
     std::vector<std::string> exts = decoder->getExts();
     std::vector<std::string>::const_iterator it = exts.begin(), itEnd = exts.end();
     for (; it != itEnd; ++it) {
@@ -18,51 +82,130 @@ void DecoderFactory::registerDecoder(img::IDecoder* decoder) {
     }
 
     decoders_list_.push_back(decoder);
-    decoder->setAlignment(align_);
-    decoder->setDecodeMode(decode_mode_);
   }
 }
 
-void DecoderFactory::setAlignment(size_t align) {
-  align_ = align;
-  DecodersMap::const_iterator it = decoders_map_.begin(), itEnd = decoders_map_.end();
-  for (; it != itEnd; ++it) {
-    it->second->setAlignment(align_);
-  }
+void DecoderFactory::setDefaultOptions(const DecodeOptions& options) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  default_options_ = options;
+}
+
+DecodeOptions DecoderFactory::getDefaultOptions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return default_options_;
 }
 
-void DecoderFactory::setDecodeMode(DecodeMode mode) {
-  decode_mode_ = mode;
+void DecoderFactory::unregisterDecoder(const std::string& ext) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DecodersMap::iterator found = decoders_map_.find(ext);
+  if (found == decoders_map_.end())
+    return;
+
+  img::IDecoder* decoder = found->second;
+  decoders_map_.erase(found);
+
+  // Decoder isn't tried for unknown extensions after its last one is gone
   DecodersMap::const_iterator it = decoders_map_.begin(), itEnd = decoders_map_.end();
   for (; it != itEnd; ++it) {
-    it->second->setDecodeMode(decode_mode_);
+    if (it->second == decoder)
+      return;
+  }
+
+  decoders_list_.remove(decoder);
+  IdleDecoders::iterator idle = idle_.find(decoder);
+  if (idle != idle_.end()) {
+    for (size_t i = 0; i < idle->second.size(); ++i)
+      delete idle->second[i];
+    idle_.erase(idle);
   }
 }
 
-void DecoderFactory::unregisterDecoder(const std::string& ext) {
-  decoders_map_.erase(ext);
+IDecoder* DecoderFactory::find(const std::string& ext) const {
+  if (ext.empty())
+    return 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  DecodersMap::const_iterator it = decoders_map_.find(ext);
+  return it != decoders_map_.end() ? it->second : 0;
 }
 
-bool DecoderFactory::decode(const std::string& ext, const tools::ByteArray& data, img::Image& image) const {
-  img::IDecoder* found = 0;
+std::vector<IDecoder*> DecoderFactory::decoders() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::vector<IDecoder*>(decoders_list_.begin(), decoders_list_.end());
+}
 
-  // search by extension first...
-  if (!ext.empty()) {
-    DecodersMap::const_iterator it = decoders_map_.find(ext);
-    if (it != decoders_map_.end())
-      found = it->second;
+IDecoder* DecoderFactory::take(const IDecoder* prototype) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<IDecoder*>& idle = idle_[prototype];
+    if (!idle.empty()) {
+      IDecoder* decoder = idle.back();
+      idle.pop_back();
+      return decoder;
+    }
+  }
+
+  return prototype->clone();
+}
+
+void DecoderFactory::giveBack(const IDecoder* prototype, IDecoder* decoder) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Decoder could be unregistered meanwhile
+  if (std::find(decoders_list_.begin(), decoders_list_.end(), prototype) == decoders_list_.end()) {
+    delete decoder;
+    return;
   }
 
-  if (found && found->decode(data, image))
+  idle_[prototype].push_back(decoder);
+}
+
+bool DecoderFactory::readSize(const std::string& ext, const tools::ByteArray& head, utils::Size& size) const {
+  const DecodeOptions options = getDefaultOptions();
+  const img::IDecoder* found = find(ext);
+  if (found && Lease(*this, found, options)->readSize(head, size))
     return true;
 
-  DecodersList::const_iterator it = decoders_list_.begin(), itEnd = decoders_list_.end();
-  for (; it != itEnd; ++it) {
-    // exclude decoder which we use on last step
-    if (*it != found && (*it)->decode(data, image))
+  const std::vector<IDecoder*> all = decoders();
+  for (size_t i = 0; i < all.size(); ++i) {
+    if (all[i] != found && Lease(*this, all[i], options)->readSize(head, size))
       return true;
   }
 
   return false;
 }
+
+bool DecoderFactory::decode(const std::string& ext, const tools::ByteArray& data, img::Image& image) const {
+  return decode(ext, data, image, getDefaultOptions());
+}
+
+bool DecoderFactory::decode(const std::string& ext, const tools::ByteArray& data, img::Image& image,
+                            const DecodeOptions& options) const {
+  // search by extension first...
+  const img::IDecoder* found = find(ext);
+  if (found && Lease(*this, found, options)->decode(data, image))
+    return CropTo(options.region, image);
+
+  const std::vector<IDecoder*> all = decoders();
+  for (size_t i = 0; i < all.size(); ++i) {
+    // exclude decoder which we use on last step
+    if (all[i] != found && Lease(*this, all[i], options)->decode(data, image))
+      return CropTo(options.region, image);
+  }
+
+  return false;
+}
+
+bool DecoderFactory::decode(const std::string& ext, tools::IInputStream& stream, img::Image& image) const {
+  return decode(ext, stream, image, getDefaultOptions());
+}
+
+bool DecoderFactory::decode(const std::string& ext, tools::IInputStream& stream, img::Image& image,
+                            const DecodeOptions& options) const {
+  const img::IDecoder* found = find(ext);
+  if (found)
+    return Lease(*this, found, options)->decode(stream, image) && CropTo(options.region, image);
+
+  const tools::ByteArray data = tools::readAll(stream);
+  return !data.isEmpty() && decode(ext, data, image, options);
+}
 }
@@ -1,15 +1,18 @@
 #pragma once
 
-#include "common/decoders/decodeMode.h"
+#include "common/decoders/decodeOptions.h"
 #include "common/defines.h"
 #include "common/singleton.h"
 
 #include <map>
 #include <list>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace tools {
 class ByteArray;
+class IInputStream;
 }
 
 namespace img {
@@ -19,27 +22,49 @@ class Image;
 namespace img {
 class IDecoder;
 
+// Registered decoders are prototypes, every call takes a clone which no
+// other thread uses, so images are decoded on several threads at once
 class DecoderFactory : public utils::SingletonStatic<DecoderFactory> {
 public:
   DecoderFactory();
+  ~DecoderFactory();
 
   void registerDecoder(img::IDecoder* decoder);
   void unregisterDecoder(const std::string& ext);
   bool decode(const std::string& ext, const tools::ByteArray& data, img::Image& image) const;
+  bool decode(const std::string& ext, const tools::ByteArray& data, img::Image& image,
+              const DecodeOptions& options) const;
+  // Stream is decoded by decoder of the extension only, it can't be read
+  // again for the others. Without such decoder the data is read as a whole.
+  bool decode(const std::string& ext, tools::IInputStream& stream, img::Image& image) const;
+  bool decode(const std::string& ext, tools::IInputStream& stream, img::Image& image,
+              const DecodeOptions& options) const;
+  // Dimensions of image from the beginning of its data, see IDecoder::readSize()
+  bool readSize(const std::string& ext, const tools::ByteArray& head, utils::Size& size) const;
 
-  void setAlignment(size_t align);
-
-  void setDecodeMode(DecodeMode mode);
+  // Options of calls which don't give their own
+  void setDefaultOptions(const DecodeOptions& options);
+  DecodeOptions getDefaultOptions() const;
 
 private:
   typedef std::map<std::string, IDecoder*> DecodersMap;
   typedef std::list<IDecoder*>    DecodersList;
+  // Clones of registered decoders which are not used now
+  typedef std::map<const IDecoder*, std::vector<IDecoder*> > IdleDecoders;
+
+  class Lease;
+
+  IDecoder* find(const std::string& ext) const;
+  std::vector<IDecoder*> decoders() const;
+  IDecoder* take(const IDecoder* prototype) const;
+  void giveBack(const IDecoder* prototype, IDecoder* decoder) const;
 
   DecodersMap decoders_map_;
   DecodersList decoders_list_;
+  DecodeOptions default_options_;
 
-  size_t align_;
-  DecodeMode decode_mode_;
+  mutable IdleDecoders idle_;
+  mutable std::mutex mutex_;
 };
 
 
@@ -3,12 +3,17 @@
 #include "common/decoders/decoderCommon.h"
 #include "common/byteArray.h"
 #include "common/image.h"
+#include "common/inputStream.h"
 
 extern "C"
 {
 #include <jpeglib.h>
 }
+#include <string.h>
+
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include "imgDecoderFactory.h"
 
@@ -17,17 +22,18 @@ void do_not_exit(j_common_ptr /*cinfo*/) {
   throw std::logic_error("Error while decoding JPEG image");
 }
 
-class JpgMemSrc : public jpeg_source_mgr {
-  const tools::ByteArray& buffer_;
+// Takes chunks from the stream when decoder asks for data
+class JpgStreamSrc : public jpeg_source_mgr {
+  tools::IInputStream& stream_;
 
-  static JpgMemSrc* getThis(j_decompress_ptr cinfo) {
-    return static_cast<JpgMemSrc*>(cinfo->src);
+  static JpgStreamSrc* getThis(j_decompress_ptr cinfo) {
+    return static_cast<JpgStreamSrc*>(cinfo->src);
   }
 
   static void do_init_source(j_decompress_ptr /*cinfo*/) {}
 
-  static boolean do_fill_input_buffer(j_decompress_ptr /*cinfo*/) {
-    return FALSE; /* We utilize I/O suspension (or emulsion? ;-) ) */
+  static boolean do_fill_input_buffer(j_decompress_ptr cinfo) {
+    return getThis(cinfo)->fill_input_buffer_impl();
   }
 
   static void do_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
@@ -38,32 +44,66 @@ class JpgMemSrc : public jpeg_source_mgr {
 
   //////////////////////////////////////////////////////////////////////////
 
+  boolean fill_input_buffer_impl() {
+    size_t size = 0;
+    if (!stream_.next(next_input_byte, size))
+      return FALSE; /* We utilize I/O suspension (or emulsion? ;-) ) */
+
+    bytes_in_buffer = size;
+    return TRUE;
+  }
+
   void skip_input_data_impl(long num_bytes) {
-    if (num_bytes > 0 && static_cast<size_t>(num_bytes) > bytes_in_buffer) {
+    if (num_bytes <= 0)
+      return;
+
+    size_t skip = static_cast<size_t>(num_bytes);
+    while (skip > bytes_in_buffer) {
+      skip -= bytes_in_buffer;
       next_input_byte += bytes_in_buffer;
       bytes_in_buffer = 0;
-    } else {
-      next_input_byte += num_bytes;
-      bytes_in_buffer -= num_bytes;
+      if (!fill_input_buffer_impl())
+        return;
     }
+
+    next_input_byte += skip;
+    bytes_in_buffer -= skip;
   }
 
-  JpgMemSrc(const JpgMemSrc&);
-  JpgMemSrc operator=(const JpgMemSrc&);
+  JpgStreamSrc(const JpgStreamSrc&);
+  JpgStreamSrc operator=(const JpgStreamSrc&);
 public:
-  JpgMemSrc(const tools::ByteArray& buffer)
-    : buffer_(buffer) {
+  JpgStreamSrc(tools::IInputStream& stream)
+    : stream_(stream) {
     init_source   = do_init_source;
     fill_input_buffer = do_fill_input_buffer;
     skip_input_data  = do_skip_input_data;
     term_source   = do_term_source;
     resync_to_restart = jpeg_resync_to_restart;
 
-    next_input_byte  = buffer.getData();
-    bytes_in_buffer  = buffer.getLength();
+    next_input_byte  = 0;
+    bytes_in_buffer  = 0;
   }
 };
 
+// Rows which libjpeg gives at once, not more than left in the image
+JDIMENSION RowsToRead(const jpeg_decompress_struct& description) {
+  return std::min<JDIMENSION>(description.rec_outbuf_height,
+                              description.output_height - description.output_scanline);
+}
+
+// Alignment bytes at the end of row are not written by decoder
+void ClearAlignment(img::Image& decoded) {
+  const size_t used = decoded.scanline(false);
+  const size_t padding = decoded.scanline(true) - used;
+  if (!padding)
+    return;
+
+  for (img::Image::SizeType y = 0; y < decoded.height(); ++y)
+    memset(decoded.data() + y * decoded.scanline(true) + used, 0, padding);
+}
+
+// Converts pixels of several rows which libjpeg writes into jpeg_buffer
 template<int SrcBytePerPixel, int DstBytePerPixel>
 class LineReader {
   public:
@@ -73,27 +113,61 @@ class LineReader {
                 description.output_height,
                 DstBytePerPixel,
                 dst_alignment);
+        ClearAlignment(decoded);
+
+        typedef img::ColorScheme<SrcBytePerPixel, DstBytePerPixel> ColorScheme;
+        typedef typename ColorScheme::DstReference DstReference;
+        typedef typename ColorScheme::SrcConstReference SrcConstReference;
+
+        const size_t dst_scanline = decoded.scanline(true);
+        while (description.output_scanline < description.output_height) {
+          const JDIMENSION first = description.output_scanline;
+          const JDIMENSION rows = jpeg_read_scanlines(&description, jpeg_buffer, RowsToRead(description));
+          if (!rows)
+            throw std::logic_error("JPEG data is incomplete");
+
+          for (JDIMENSION row = 0; row < rows; ++row) {
+            const unsigned char* src = jpeg_buffer[row];
+            unsigned char* dst = decoded.data() + (first + row) * dst_scanline;
+            for (JDIMENSION x = 0; x < description.output_width; ++x, src += SrcBytePerPixel, dst += DstBytePerPixel)
+              DstReference(dst, SrcConstReference(src));
+          }
+        }
+    }
+};
 
-        img::DestinationIterator<DstBytePerPixel, true> dst_it(decoded);
-        const int src_scanline = SrcBytePerPixel * description.output_height;
-
-        for (unsigned short y = 0; y < description.output_height; ++y) {
-          jpeg_read_scanlines(&description, jpeg_buffer, 1);
-          img::SourceIterator<SrcBytePerPixel> src_it(jpeg_buffer[0], src_scanline, src_scanline);
-
-          for (unsigned short x = 0; x < description.output_width; ++x) {
-            typedef img::ColorScheme<SrcBytePerPixel, DstBytePerPixel> ColorScheme;
-            typedef typename ColorScheme::DstReference DstReference;
-            typedef typename ColorScheme::SrcConstReference SrcConstReference;
+// Output of libjpeg has layout of the image, so rows are decoded in place
+template<int BytePerPixel>
+class DirectReader {
+  public:
+    static void load(img::Image& decoded, jpeg_decompress_struct& description, JSAMPARRAY& /*jpeg_buffer*/, int dst_alignment) {
+        decoded.create(
+                description.output_width,
+                description.output_height,
+                BytePerPixel,
+                dst_alignment);
+        ClearAlignment(decoded);
 
-            DstReference(dst_it++, SrcConstReference(src_it++));
-          }
+        std::vector<JSAMPROW> rows(description.output_height);
+        for (JDIMENSION y = 0; y < description.output_height; ++y)
+          rows[y] = decoded.data() + y * decoded.scanline(true);
 
-          dst_it.nextLine();
+        while (description.output_scanline < description.output_height) {
+          if (!jpeg_read_scanlines(&description, &rows[description.output_scanline], RowsToRead(description)))
+            throw std::logic_error("JPEG data is incomplete");
         }
     }
 };
 
+template<>
+class LineReader<1, 1> : public DirectReader<1> {};
+
+#ifdef JCS_EXTENSIONS
+// Colors are asked as BGR, see JpegDecoder::chooseColorSpace()
+template<>
+class LineReader<3, 3> : public DirectReader<3> {};
+#endif
+
 typedef void (*LoadFunction)(img::Image& decoded, jpeg_decompress_struct& description, JSAMPARRAY& jpeg_buffer, int dst_alignment);
 const unsigned int MaxDestinationDecodeMode = img::DecodeAsIs;
 const unsigned int MaxSourceBytePerPixel = 4;
@@ -133,6 +207,10 @@ class JpegDecoder : public IDecoder {
   jpeg_decompress_struct desc_;
   jpeg_error_mgr error_;
 
+  virtual IDecoder* clone() const {
+    return new JpegDecoder;
+  }
+
   virtual std::vector<std::string> getExts() const {
     std::vector<std::string> exts;
 
@@ -150,24 +228,91 @@ class JpegDecoder : public IDecoder {
     if (encoded.isEmpty())
       return false;
 
+    tools::ByteArrayInputStream stream(encoded);
+    return decode(stream, decoded);
+  }
+
+  virtual bool decode(tools::IInputStream& encoded, img::Image& decoded) {
+    if (decodeStream(encoded, decoded))
+      return true;
+
+    // Failed one leaves decompressor in the middle of the data
+    jpeg_abort_decompress(&desc_);
+    return false;
+  }
+
+  virtual bool readSize(const tools::ByteArray& head, utils::Size& size) {
+    tools::ByteArrayInputStream stream(head);
+    JpgStreamSrc stream_src(stream);
+    desc_.src = &stream_src;
+
+    bool result = false;
+    try {
+      // Suspends when SOF isn't in the head
+      if (JPEG_HEADER_OK == jpeg_read_header(&desc_, TRUE)) {
+        size = utils::Size(desc_.image_width, desc_.image_height);
+        result = size.width && size.height;
+      }
+    } catch(...) {}
+
+    jpeg_abort_decompress(&desc_);
+    return result;
+  }
+
+  // Reduced image is decoded by IDCT of smaller size, which is much faster
+  // than decoding the whole one and scaling it afterwards
+  void chooseScale() {
+    const utils::Size& target = getTargetSize();
+    if (!target.width && !target.height)
+      return;
+
+    for (unsigned int denom = 8; denom > 1; denom /= 2) {
+      if (desc_.image_width / denom >= target.width && desc_.image_height / denom >= target.height) {
+        desc_.scale_num = 1;
+        desc_.scale_denom = denom;
+        return;
+      }
+    }
+  }
+
+  // Image keeps color pixels as BGR, so libjpeg of turbo version gives
+  // them ready to be copied. Gray image is luma of YCbCr, then chroma isn't
+  // decoded, upsampled and converted at all.
+  void chooseColorSpace() {
+    if (DecodeIntoGray == getDecodeMode() && JCS_YCbCr == desc_.jpeg_color_space) {
+      desc_.out_color_space = JCS_GRAYSCALE;
+      return;
+    }
+
+#ifdef JCS_EXTENSIONS
+    if (JCS_RGB == desc_.out_color_space &&
+        (DecodeAsIs == getDecodeMode() || DecodeIntoRgb == getDecodeMode()))
+      desc_.out_color_space = JCS_EXT_BGR;
+#endif
+  }
+
+  bool decodeStream(tools::IInputStream& encoded, img::Image& decoded) {
     volatile bool decompress_started = false;
 
-    JpgMemSrc mem_src(encoded);
-    desc_.src = &mem_src;
+    JpgStreamSrc stream_src(encoded);
+    desc_.src = &stream_src;
 
     try {
       int rc = jpeg_read_header(&desc_, TRUE);
       if (rc != JPEG_HEADER_OK)
         return false;
 
+      chooseScale();
+      chooseColorSpace();
       decompress_started = jpeg_start_decompress(&desc_) != 0;
       if (!decompress_started) {
         throw std::logic_error("Failed to start decompression");
       }
 
-      // TODO: memoryleak?
+      // Freed by libjpeg with the image pool
       JSAMPARRAY pJpegBuffer =
-        (*desc_.mem->alloc_sarray)((j_common_ptr) & desc_, JPOOL_IMAGE, desc_.output_width * desc_.output_components, 1);
+        (*desc_.mem->alloc_sarray)((j_common_ptr) & desc_, JPOOL_IMAGE, desc_.output_width * desc_.output_components,
+                                   desc_.rec_outbuf_height);
 
       int height = desc_.output_height;
       if (height <= 0)
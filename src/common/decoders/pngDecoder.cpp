@@ -3,13 +3,17 @@
 
 #include <png.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 
 #include "common/byteArray.h"
 #include "common/image.h"
+#include "common/inputStream.h"
 
 namespace {
+const int PngSignatureLength = 8;
+
 static void img_my_png_error(png_structp /*png_ptr*/, png_const_charp error_string) {
   std::stringstream info;
   info << "Error while decoding PNG image: " << error_string;
@@ -18,34 +22,39 @@ static void img_my_png_error(png_structp /*png_ptr*/, png_const_charp error_stri
 
 static void img_my_png_warning(png_structp /*a*/, png_const_charp /*b*/) {}
 
-struct MemPngSrc {
-  const tools::ByteArray& array;
-  tools::ByteArray::SizeType seek;
-
-  MemPngSrc(const tools::ByteArray& array)
-    : array(array), seek(0) {}
+// Copies requested bytes from chunks of the stream
+class StreamPngSrc {
+  tools::IInputStream& stream_;
+  const unsigned char* data_;
+  size_t size_;
+
+  StreamPngSrc(const StreamPngSrc&);
+  StreamPngSrc operator = (const StreamPngSrc&);
+public:
+  StreamPngSrc(tools::IInputStream& stream)
+    : stream_(stream), data_(0), size_(0) {}
+
+  bool read(unsigned char* out, size_t count) {
+    while (count) {
+      if (!size_ && !stream_.next(data_, size_))
+        return false;
+
+      const size_t part = std::min(count, size_);
+      memcpy(out, data_, part);
+      out += part;
+      count -= part;
+      data_ += part;
+      size_ -= part;
+    }
 
-private:
-  MemPngSrc(const MemPngSrc&);
-  MemPngSrc operator = (const MemPngSrc&);
+    return true;
+  }
 };
 
-void ReadDataFromMemory(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
+void ReadDataFromStream(png_structp png_ptr, png_bytep outBytes, png_size_t byteCountToRead) {
   png_voidp io_ptr = png_get_io_ptr(png_ptr);
-  if (!io_ptr)
-    throw std::logic_error("Error while decoding PNG image");   // add custom error handling here
-
-  // using spark::InputStream
-  // -> replace with your own data source interface
-  const tools::ByteArray& array = static_cast<MemPngSrc*>(io_ptr)->array;
-  tools::ByteArray::SizeType& seek = static_cast<MemPngSrc*>(io_ptr)->seek;
-  tools::ByteArray::SizeType still_in_array = array.getLength() - seek;
-
-  if (still_in_array < byteCountToRead)
+  if (!io_ptr || !static_cast<StreamPngSrc*>(io_ptr)->read(outBytes, byteCountToRead))
     throw std::logic_error("Error while decoding PNG image");
-
-  memcpy(outBytes, array.getData() + seek, byteCountToRead);
-  seek += byteCountToRead;
 }
 
 inline bool do_use_swap() {
@@ -64,6 +73,10 @@ inline bool do_use_swap() {
 
 namespace img {
 class PngDecoder : public IDecoder {
+  virtual IDecoder* clone() const {
+    return new PngDecoder;
+  }
+
   virtual std::vector<std::string> getExts() const {
     std::vector<std::string> exts;
 
@@ -96,10 +109,29 @@ class PngDecoder : public IDecoder {
   };
 
   virtual bool decode(const tools::ByteArray& encoded, img::Image& decoded) {
-    static const int PngSignatureLength = 8;
+    tools::ByteArrayInputStream stream(encoded);
+    return decode(stream, decoded);
+  }
+
+  // IHDR is the first chunk, so its width and height follow the signature,
+  // length and type of the chunk
+  virtual bool readSize(const tools::ByteArray& head, utils::Size& size) {
+    static const size_t IhdrSizeEnd = PngSignatureLength + 16;
 
-    if (encoded.getSize() < PngSignatureLength ||
-        !png_check_sig(const_cast<png_bytep>(encoded.getData()), PngSignatureLength))
+    const unsigned char* data = head.getData();
+    if (head.getSize() < IhdrSizeEnd || !png_check_sig(const_cast<png_bytep>(data), PngSignatureLength) ||
+        0 != memcmp(data + PngSignatureLength + 4, "IHDR", 4))
+      return false;
+
+    size = utils::Size(png_get_uint_32(data + PngSignatureLength + 8), png_get_uint_32(data + PngSignatureLength + 12));
+    return size.width && size.height;
+  }
+
+  virtual bool decode(tools::IInputStream& encoded, img::Image& decoded) {
+    StreamPngSrc stream_src(encoded);
+    png_byte signature[PngSignatureLength];
+    if (!stream_src.read(signature, PngSignatureLength) ||
+        !png_check_sig(signature, PngSignatureLength))
       return false;
 
     PngStruct png;
@@ -117,9 +149,8 @@ class PngDecoder : public IDecoder {
       return false;
 
     try {
-      MemPngSrc mem_src(encoded);
-
-      png_set_read_fn(png.png_ptr, &mem_src, ReadDataFromMemory);
+      png_set_read_fn(png.png_ptr, &stream_src, ReadDataFromStream);
+      png_set_sig_bytes(png.png_ptr, PngSignatureLength);
       png_read_info(png.png_ptr, png.info_ptr);
 
       const unsigned int bit_depth = png_get_bit_depth(png.png_ptr, png.info_ptr);
@@ -183,8 +214,16 @@ class PngDecoder : public IDecoder {
       const unsigned int width = png_get_image_width(png.png_ptr, png.info_ptr);
       const unsigned int height = png_get_image_height(png.png_ptr, png.info_ptr);
 
+      // Alpha channel is kept as is
+      if (decode_mode == DecodeAsIs)
+        src_bytes_per_pixel = png_get_channels(png.png_ptr, png.info_ptr);
+
       decoded.create(width, height, src_bytes_per_pixel, getAlignment());
 
+      // Rows which don't fit the image aren't read over its end
+      if (png_get_rowbytes(png.png_ptr, png.info_ptr) > decoded.scanline(false))
+        return false;
+
       const unsigned int scanline = decoded.scanline(true);
 
       png.row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * height);
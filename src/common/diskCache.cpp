@@ -0,0 +1,253 @@
+#include "diskCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "byteArray.h"
+#include "filemanager.h"
+#include "mappedFile.h"
+
+namespace {
+const char Magic[4] = { 'P', 'M', 'D', 'C' };
+const unsigned Version = 1;
+// Offset of stored data in file is multiple of it
+const size_t DataAlignment = 16;
+
+const char Extension[] = ".page";
+
+// File starts with header followed by key and aligned data
+struct Header {
+  char magic[4];
+  unsigned version;
+  unsigned key_size;
+  unsigned data_offset;
+  unsigned long long data_size;
+};
+
+size_t alignedOffset(size_t offset) {
+  return (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+}
+
+// FNV-1a
+unsigned long long hashOf(const std::string& key) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (std::string::const_iterator it = key.begin(), itEnd = key.end(); it != itEnd; ++it) {
+    hash ^= static_cast<unsigned char>(*it);
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+bool restoreFrom(const unsigned char* file, size_t file_size, const std::string& key, manga::IBookCache& cache) {
+  Header header;
+  if (file_size < sizeof(header))
+    return false;
+
+  memcpy(&header, file, sizeof(header));
+  if (0 != memcmp(header.magic, Magic, sizeof(Magic)) ||
+      Version != header.version ||
+      key.size() != header.key_size ||
+      header.data_offset < sizeof(header) + header.key_size ||
+      header.data_offset > file_size ||
+      header.data_size > file_size - header.data_offset)
+    return false;
+
+  // Different keys could have the same hash
+  if (0 != memcmp(file + sizeof(header), key.data(), key.size()))
+    return false;
+
+  return cache.restore(file + header.data_offset, static_cast<size_t>(header.data_size));
+}
+
+// File left by previous run
+struct OldFile {
+  time_t modified;
+  std::string name;
+  unsigned long long size;
+
+  OldFile(time_t modified, const std::string& name, unsigned long long size)
+    : modified(modified), name(name), size(size) {}
+
+  bool operator <(const OldFile& other) const {
+    return modified < other.modified || (modified == other.modified && name < other.name);
+  }
+};
+
+bool restoreFromFile(const std::string& file_name, const std::string& key, manga::IBookCache& cache) {
+  tools::MappedFile file;
+  return file.open(file_name) && restoreFrom(file.data(), file.size(), key, cache);
+}
+}
+
+namespace manga {
+DiskCache::DiskCache(const fs::FilePath& directory, unsigned long long max_size)
+  : directory_(directory), max_size_(max_size), size_(0) {
+  std::auto_ptr<fs::IFileManager> file_mgr(fs::IFileManager::create());
+  const std::vector<fs::FilePath> files = file_mgr->getFileList(directory_, fs::IFileManager::File, false);
+
+  const std::string extension = Extension;
+  std::vector<OldFile> old_files;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string name = files[i].getName();
+    struct stat info;
+    if (name.size() <= extension.size() ||
+        0 != name.compare(name.size() - extension.size(), extension.size(), extension) ||
+        0 != stat(files[i].getPath().c_str(), &info))
+      continue;
+
+    old_files.push_back(OldFile(info.st_mtime, name, info.st_size));
+  }
+
+  // Uses of previous runs aren't known, older files go first
+  std::sort(old_files.begin(), old_files.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < old_files.size(); ++i)
+    add(old_files[i].name, old_files[i].size);
+
+  evict();
+}
+
+const fs::FilePath& DiskCache::directory() const {
+  return directory_;
+}
+
+unsigned long long DiskCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+bool DiskCache::find(const PathToFile& path, time_t modified, const std::string& decoding, IBookCache& cache) {
+  const std::string key = makeKey(path, modified, decoding, cache);
+  if (key.empty())
+    return false;
+
+  const std::string file_name = fileName(key);
+  if (!restoreFromFile(pathOf(file_name), key, cache))
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  touch(file_name);
+  return true;
+}
+
+bool DiskCache::insert(const PathToFile& path, time_t modified, const std::string& decoding,
+                       const IBookCache& cache) {
+  const std::string key = makeKey(path, modified, decoding, cache);
+  tools::ByteArray data;
+  if (key.empty() || !cache.save(data))
+    return false;
+
+  Header header;
+  memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.key_size = static_cast<unsigned>(key.size());
+  header.data_offset = static_cast<unsigned>(alignedOffset(sizeof(header) + key.size()));
+  header.data_size = data.getSize();
+
+  const std::vector<char> padding(header.data_offset - sizeof(header) - key.size(), 0);
+
+  // Readers never see partially written file
+  const std::string file_name = fileName(key);
+  const std::string file_path = pathOf(file_name);
+  std::ostringstream temp_name;
+  temp_name << file_path << '.' << std::this_thread::get_id() << ".tmp";
+
+  {
+    std::ofstream file(temp_name.str().c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(key.data(), key.size());
+    if (!padding.empty())
+      file.write(&padding[0], padding.size());
+
+    if (!data.isEmpty())
+      file.write(reinterpret_cast<const char*>(data.getData()), data.getSize());
+
+    if (!file) {
+      file.close();
+      remove(temp_name.str().c_str());
+      return false;
+    }
+  }
+
+  if (0 != rename(temp_name.str().c_str(), file_path.c_str())) {
+    remove(temp_name.str().c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  add(file_name, header.data_offset + header.data_size);
+  evict();
+  // File larger than the whole cache isn't kept
+  return stored_.find(file_name) != stored_.end();
+}
+
+std::string DiskCache::makeKey(const PathToFile& path, time_t modified, const std::string& decoding,
+                               const IBookCache& cache) const {
+  const std::string cache_key = cache.persistentKey();
+  if (cache_key.empty())
+    return std::string();
+
+  std::ostringstream key;
+  key << path.filePath.getPath() << '\n'
+      << path.pathInArchive.getPath() << '\n'
+      << static_cast<long long>(modified) << '\n'
+      << decoding << '\n'
+      << cache_key;
+  return key.str();
+}
+
+std::string DiskCache::fileName(const std::string& key) {
+  char name[32];
+  sprintf(name, "%016llx%s", hashOf(key), Extension);
+  return name;
+}
+
+std::string DiskCache::pathOf(const std::string& file_name) const {
+  fs::FilePath file = directory_;
+  file.setFile(file_name);
+  return file.getPath();
+}
+
+void DiskCache::touch(const std::string& file_name) {
+  std::map<std::string, Stored>::iterator found = stored_.find(file_name);
+  if (found != stored_.end())
+    uses_.splice(uses_.end(), uses_, found->second.use);
+}
+
+void DiskCache::add(const std::string& file_name, unsigned long long size) {
+  std::map<std::string, Stored>::iterator found = stored_.find(file_name);
+  if (found != stored_.end()) {
+    size_ -= found->second.size;
+    uses_.erase(found->second.use);
+    stored_.erase(found);
+  }
+
+  uses_.push_back(file_name);
+  Stored& stored = stored_[file_name];
+  stored.size = size;
+  stored.use = --uses_.end();
+  size_ += size;
+}
+
+void DiskCache::evict() {
+  while (size_ > max_size_ && !uses_.empty()) {
+    const std::string file_name = uses_.front();
+    remove(pathOf(file_name).c_str());
+
+    std::map<std::string, Stored>::iterator found = stored_.find(file_name);
+    size_ -= found->second.size;
+    stored_.erase(found);
+    uses_.pop_front();
+  }
+}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <time.h>
+
+#include "book.h"
+
+namespace manga {
+// Keeps results of IBookCache in files of a directory. File of a page is
+// found by path of the page, modification time of its file or archive,
+// options of decoding (see PageCache::Key) and persistent key of the
+// cache, so changed books and other settings don't get stale results. Data in files is aligned and read through mmap
+// where it's available. Files take at most max_size bytes, least recently
+// used ones are removed when it's exceeded, stale files go first as they
+// aren't used anymore. Methods can be called from any thread.
+class DiskCache {
+public:
+  // Files left by previous runs are counted and removed over the limit
+  DiskCache(const fs::FilePath& directory, unsigned long long max_size);
+
+  const fs::FilePath& directory() const;
+  // Bytes taken by files of the cache
+  unsigned long long size() const;
+
+  bool find(const PathToFile& path, time_t modified, const std::string& decoding, IBookCache& cache);
+  bool insert(const PathToFile& path, time_t modified, const std::string& decoding, const IBookCache& cache);
+
+private:
+  struct Stored {
+    unsigned long long size;
+    std::list<std::string>::iterator use;
+  };
+
+  std::string makeKey(const PathToFile& path, time_t modified, const std::string& decoding,
+                      const IBookCache& cache) const;
+  static std::string fileName(const std::string& key);
+  std::string pathOf(const std::string& file_name) const;
+  // Following three are called under lock
+  void touch(const std::string& file_name);
+  void add(const std::string& file_name, unsigned long long size);
+  void evict();
+
+  fs::FilePath directory_;
+  unsigned long long max_size_;
+
+  mutable std::mutex mutex_;
+  // File names, least recently used first
+  std::list<std::string> uses_;
+  std::map<std::string, Stored> stored_;
+  unsigned long long size_;
+};
+}
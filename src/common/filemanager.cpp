@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <fstream>
 
+#include <sys/stat.h>
+
 #include "filepath.h"
 
 #include "byteArray.h"
@@ -136,8 +138,23 @@ tools::ByteArray IFileManager::readFile(const fs::FilePath& file_path, size_t ma
   return data;
 }
 
+bool IFileManager::getModificationTime(const fs::FilePath& file_path, time_t& time) {
+  struct stat info;
+  if (0 != stat(file_path.getPath().c_str(), &info))
+    return false;
+
+  time = info.st_mtime;
+  return true;
+}
+
+IFileWatcher* IFileManager::createWatcher() {
+  return 0;
+}
+
 IFileManager::~IFileManager() {}
 
+IFileWatcher::~IFileWatcher() {}
+
 
 //////////////////////////////////////////////////////////////////////////
 }
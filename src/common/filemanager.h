@@ -4,12 +4,15 @@
 
 #include <vector>
 
+#include <time.h>
+
+#include "filepath.h"
+
 namespace tools {
 class ByteArray;
 }
 
 namespace fs {
-class FilePath;
 
 class Comparator {
   virtual bool compareLevel(const std::string& name1, const std::string& name2, bool& result) const = 0;
@@ -26,6 +29,36 @@ class NumberOrder : public Comparator {
   virtual bool compareLevel(const std::string& name1, const std::string& name2, bool& result) const;
 };
 
+struct FileChange {
+  enum Type {
+    Created,
+    Deleted
+  };
+
+  Type type;
+  FilePath path;
+
+  FileChange(Type type, const FilePath& path)
+    : type(type), path(path) {}
+};
+
+// Reports changes of a directory tree. Moved entries are reported as
+// deleted from old place and created in new one. Directories are watched
+// as they are listed, so watching doesn't scan the tree.
+class IFileWatcher {
+public:
+  // Watches root alone, directories watched before are forgotten
+  virtual bool watch(const FilePath& root) = 0;
+  // Watches directory which is about to be listed. False when it can't be
+  // watched, then poll() reports that changes were lost.
+  virtual bool addDirectory(const FilePath& dir) = 0;
+  // Appends changes made since previous call without blocking, returns
+  // false when some changes were lost
+  virtual bool poll(std::vector<FileChange>& changes) = 0;
+
+  virtual ~IFileWatcher();
+};
+
 class IFileManager {
 public:
   enum EntryTypes {
@@ -37,6 +70,9 @@ public:
   //virtual std::vector<fs::FilePath> getFileList(const std::string &root, EntryTypes entries, bool recursive) = 0;
   virtual std::vector<fs::FilePath> getFileList(const fs::FilePath& root, EntryTypes entries, bool recursive) = 0;
   virtual tools::ByteArray readFile(const fs::FilePath& file, size_t max_size);
+  virtual bool getModificationTime(const fs::FilePath& file, time_t& time);
+  // Returns 0 when changes can't be watched
+  virtual IFileWatcher* createWatcher();
 
   virtual ~IFileManager();
 
@@ -7,58 +7,287 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include "filepath.h"
 
 namespace fs {
 namespace lin {
-class FileManagerLin: public IFileManager {
-  void appendFileName(std::string &parent, const std::string &file) {
-    if( parent.empty() )
-      parent = file;
+void appendFileName(std::string &path, const std::string &parent, const char *file) {
+  path = parent;
+  if( path.empty() || path[path.size() - 1] != '/' )
+    path += '/';
 
-    if( parent[parent.size() - 1] != '\\' && parent[parent.size() - 1] != '/' )
-      parent.append("/");
+  path += file;
+}
 
-    parent.append(file);
-  }
+// Walks directory tree on a few threads. Every directory is read into its
+// own node, result is built from the nodes in readdir order, so it doesn't
+// depend on which thread read what.
+class ParallelScanner {
+  struct Node;
 
-  void doGetFileList(std::vector<fs::FilePath> &result , const std::string &root, EntryTypes entries, bool recursive) {
-    struct dirent *dp;
-    DIR *dir = opendir(root.c_str());
-    if( !dir )
+  struct Item {
+    std::string path;
+    bool is_dir;
+    Node *child;
+  };
+
+  struct Node {
+    std::string path;
+    std::vector<Item> items;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  // Nodes are never moved
+  std::deque<Node> nodes_;
+  std::deque<Node*> queue_;
+  size_t active_;
+  bool recursive_;
+
+  void read(Node &node) {
+    const int fd = openat(AT_FDCWD, node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if( -1 == fd )
       return;
 
-    while ((dp=readdir(dir)) != NULL) {
-      std::string full_path = root;
-      const std::string name = dp->d_name;
+    DIR *dir = fdopendir(fd);
+    if( !dir ) {
+      close(fd);
+      return;
+    }
+
+    struct dirent *dp;
+    while( (dp = readdir(dir)) != NULL ) {
+      const char *name = dp->d_name;
+      if( !strcmp(name, ".") || !strcmp(name, "..") )
+        continue;
 
-      const bool is_dir = (dp->d_type == DT_DIR);
+      bool is_dir = (dp->d_type == DT_DIR);
+      if( dp->d_type == DT_UNKNOWN ) {
+        // Some file systems don't fill type
+        struct stat info;
+        is_dir = (0 == fstatat(dirfd(dir), name, &info, AT_SYMLINK_NOFOLLOW)) && S_ISDIR(info.st_mode);
+      }
+
+      Item item;
+      appendFileName(item.path, node.path, name);
+      item.is_dir = is_dir;
+      item.child = 0;
+      node.items.push_back(item);
+    }
+    closedir(dir);
+  }
 
-      if( !name.empty() && name != "." && name != ".." ) {
-        appendFileName(full_path, name);
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for( ;; ) {
+      while( queue_.empty() && active_ )
+        cond_.wait(lock);
 
-        fs::FilePath path(full_path, !is_dir );
+      if( queue_.empty() )
+        return;
 
-        if( (entries & IFileManager::File) && !is_dir )
-          result.push_back(path);
+      Node *node = queue_.front();
+      queue_.pop_front();
+      ++active_;
+      lock.unlock();
 
-        if( (entries & IFileManager::Directory) && is_dir )
-          result.push_back(path);
+      read(*node);
 
-        if( recursive && is_dir )
-          doGetFileList(result, full_path, entries, recursive);
+      lock.lock();
+      if( recursive_ ) {
+        for( size_t i = 0; i < node->items.size(); ++i ) {
+          Item &item = node->items[i];
+          if( !item.is_dir )
+            continue;
 
-      };
+          nodes_.push_back(Node());
+          item.child = &nodes_.back();
+          item.child->path = item.path;
+          queue_.push_back(item.child);
+        }
+      }
+
+      --active_;
+      cond_.notify_all();
     }
-    closedir(dir);
   }
 
+  void collect(const Node &node, IFileManager::EntryTypes entries, std::vector<fs::FilePath> &result) const {
+    for( size_t i = 0; i < node.items.size(); ++i ) {
+      const Item &item = node.items[i];
+      if( (item.is_dir && (entries & IFileManager::Directory)) ||
+          (!item.is_dir && (entries & IFileManager::File)) )
+        result.push_back(fs::FilePath(item.path, !item.is_dir));
+
+      if( item.child )
+        collect(*item.child, entries, result);
+    }
+  }
+
+public:
+  ParallelScanner()
+    : active_(0), recursive_(false) {}
+
+  void scan(std::vector<fs::FilePath> &result, const std::string &root, IFileManager::EntryTypes entries, bool recursive) {
+    recursive_ = recursive;
+    nodes_.push_back(Node());
+    nodes_.back().path = root;
+    queue_.push_back(&nodes_.back());
+
+    // Scanning waits for disk mostly, so there are more threads than cores
+    const size_t workers = recursive ? std::min(std::max(2 * std::thread::hardware_concurrency(), 2U), 8U) : 1;
+    std::vector<std::thread> threads;
+    for( size_t i = 1; i < workers; ++i )
+      threads.push_back(std::thread(&ParallelScanner::run, this));
+
+    run();
+    for( size_t i = 0; i < threads.size(); ++i )
+      threads[i].join();
+
+    collect(nodes_.front(), entries, result);
+  }
+};
+
+#ifdef __linux__
+// Every listed directory of the tree has its own inotify watch, watches
+// are removed when directories are moved and deleted.
+class InotifyWatcher: public IFileWatcher {
+  int fd_;
+  // Watch descriptor to path of directory
+  std::map<int, std::string> dirs_;
+  // Some directory isn't watched, changes in it are lost
+  bool lost_;
+
+  bool addWatch(std::string path) {
+    if( path.size() > 1 && path[path.size() - 1] == '/' )
+      path.erase(path.size() - 1);
+
+    const int wd = inotify_add_watch(fd_, path.c_str(),
+                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if( -1 == wd ) {
+      // Directory which is gone is reported deleted by its parent
+      if( ENOENT != errno )
+        lost_ = true;
+
+      return false;
+    }
+
+    dirs_[wd] = path;
+    return true;
+  }
+
+  void removeTree(const std::string &path) {
+    const std::string prefix = path + '/';
+    for( std::map<int, std::string>::iterator it = dirs_.begin(); it != dirs_.end(); ) {
+      if( it->second == path || 0 == it->second.compare(0, prefix.size(), prefix) ) {
+        inotify_rm_watch(fd_, it->first);
+        dirs_.erase(it++);
+      } else
+        ++it;
+    }
+  }
+
+public:
+  InotifyWatcher()
+    : fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), lost_(false) {}
+
+  ~InotifyWatcher() {
+    if( -1 != fd_ )
+      close(fd_);
+  }
+
+  virtual bool watch(const fs::FilePath &root) {
+    if( -1 == fd_ )
+      return false;
+
+    for( std::map<int, std::string>::iterator it = dirs_.begin(); it != dirs_.end(); ++it )
+      inotify_rm_watch(fd_, it->first);
+
+    dirs_.clear();
+    lost_ = false;
+    return addWatch(root.getPath());
+  }
+
+  virtual bool addDirectory(const fs::FilePath &dir) {
+    return -1 != fd_ && addWatch(dir.getPath());
+  }
+
+  virtual bool poll(std::vector<FileChange> &changes) {
+    bool complete = !lost_;
+    lost_ = false;
+    char buffer[16 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    for( ;; ) {
+      const ssize_t size = read(fd_, buffer, sizeof(buffer));
+      if( size <= 0 )
+        break;
+
+      for( const char *ptr = buffer; ptr < buffer + size; ) {
+        const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+        ptr += sizeof(struct inotify_event) + event->len;
+
+        if( event->mask & IN_Q_OVERFLOW ) {
+          complete = false;
+          continue;
+        }
+
+        if( event->mask & IN_IGNORED ) {
+          dirs_.erase(event->wd);
+          continue;
+        }
+
+        std::map<int, std::string>::const_iterator dir = dirs_.find(event->wd);
+        if( dir == dirs_.end() || !event->len )
+          continue;
+
+        std::string path;
+        appendFileName(path, dir->second, event->name);
+        const bool is_dir = (0 != (event->mask & IN_ISDIR));
+
+        if( event->mask & (IN_CREATE | IN_MOVED_TO) ) {
+          // New directory is reported alone, receiver adds its watch when
+          // it lists the directory
+          changes.push_back(FileChange(FileChange::Created, fs::FilePath(path, !is_dir)));
+        } else if( event->mask & (IN_DELETE | IN_MOVED_FROM) ) {
+          if( is_dir )
+            removeTree(path);
+
+          changes.push_back(FileChange(FileChange::Deleted, fs::FilePath(path, !is_dir)));
+        }
+      }
+    }
+
+    return complete;
+  }
+};
+#endif
+
+class FileManagerLin: public IFileManager {
   virtual std::vector<fs::FilePath> getFileList(const fs::FilePath &root, EntryTypes entries, bool recursive) {
     std::vector<fs::FilePath> result;
-    doGetFileList(result ,root.getPath(), entries, recursive);
+    ParallelScanner().scan(result, root.getPath(), entries, recursive);
     return result;
   }
+
+#ifdef __linux__
+  virtual IFileWatcher *createWatcher() {
+    return new InotifyWatcher;
+  }
+#endif
 };
 }
 
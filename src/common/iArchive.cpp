@@ -2,6 +2,8 @@
 
 #include "common/archives/zipArchive.h"
 
+#include <algorithm>
+#include <limits>
 #include <map>
 
 namespace archive {
@@ -22,7 +24,8 @@ public:
     archivers_.erase(pref_ext);
   }
 
-  IArchive* recognize(const fs::FilePath& path) const {
+  // Archive is read from data when it's given
+  IArchive* recognize(const fs::FilePath& path, const tools::ByteArray* data) const {
     if (path.isDirectory())
       return 0;
 
@@ -33,20 +36,67 @@ public:
     Archivers::const_iterator itExt = archivers_.find(ext);
     if (itExt != archivers_.end()) {
       conc_arch.reset(itExt->second());
-      if (conc_arch->open(path.getPath()))
+      if (open(*conc_arch, path, data))
         return conc_arch.release();
     }
 
     for (Archivers::const_iterator it = archivers_.begin(), itEnd = archivers_.end(); it != itEnd; ++it) {
       conc_arch.reset(it->second());
-      if (conc_arch->open(path.getPath()))
+      if (open(*conc_arch, path, data))
         return conc_arch.release();
     }
 
     return 0;
   }
+
+private:
+  static bool open(IArchive& archive, const fs::FilePath& path, const tools::ByteArray* data) {
+    return data ? archive.openMemory(*data, path.getPath()) : archive.open(path.getPath());
+  }
 };
 
+bool IArchive::openMemory(const tools::ByteArray& /*data*/, const std::string& /*name*/) {
+  return false;
+}
+
+std::vector<tools::ByteArray> IArchive::getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+  std::vector<tools::ByteArray> result(files.size());
+  for (size_t i = 0; i < files.size(); ++i)
+    result[i] = getFile(files[i], max_size);
+
+  return result;
+}
+
+std::auto_ptr<tools::IInputStream> IArchive::openFile(const fs::FilePath& file_in_archive, size_t max_size) {
+  const tools::ByteArray data = getFile(file_in_archive, max_size);
+  if (data.isEmpty())
+    return std::auto_ptr<tools::IInputStream>();
+
+  return std::auto_ptr<tools::IInputStream>(new tools::ByteArrayInputStream(data));
+}
+
+tools::ByteArray IArchive::getFileHead(const fs::FilePath& file_in_archive, size_t size) {
+  tools::ByteArray head;
+  std::auto_ptr<tools::IInputStream> stream = openFile(file_in_archive, std::numeric_limits<size_t>::max());
+  const unsigned char* data = 0;
+  size_t chunk = 0;
+  while (stream.get() && head.getSize() < size && stream->next(data, chunk))
+    tools::append(head, data, std::min(chunk, size - head.getSize()));
+
+  return head;
+}
+
+std::vector<tools::ByteArray> IArchive::getFileHeads(const std::vector<fs::FilePath>& files, size_t size) {
+  std::vector<tools::ByteArray> result(files.size());
+  for (size_t i = 0; i < files.size(); ++i)
+    result[i] = getFileHead(files[i], size);
+
+  return result;
+}
+
+void IArchive::releaseCaches() {
+}
+
 void IArchive::registerArchiver(const std::string& pref_ext, IArchive::FactoryMethod method) {
   ArchiveFactory::instance().registerArchiver(pref_ext, method);
 }
@@ -56,6 +106,10 @@ void IArchive::unregisterArchiver(const std::string& pref_ext) {
 }
 
 IArchive* recognize(const fs::FilePath& path) {
-  return ArchiveFactory::instance().recognize(path);
+  return ArchiveFactory::instance().recognize(path, 0);
+}
+
+IArchive* recognize(const fs::FilePath& path, const tools::ByteArray& data) {
+  return ArchiveFactory::instance().recognize(path, &data);
 }
 }
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "byteArray.h"
 #include "filepath.h"
+#include "inputStream.h"
 #include "defines.h"
 
 namespace archive {
@@ -13,9 +15,29 @@ public:
   virtual ~IArchive() {};
 
   virtual bool open(const std::string& file) = 0;
+  // Opens archive which is already in memory, like one nested in another
+  // archive. Name is used as file name to tell type of archive.
+  virtual bool openMemory(const tools::ByteArray& data, const std::string& name);
   virtual void close() = 0;
   virtual std::vector<fs::FilePath> getFileList(bool files_only) = 0;
   virtual tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) = 0;
+  // Reads several files at once, archives read them in one pass in their
+  // own order. Result is in order of files, missing ones are empty.
+  virtual std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath>& files, size_t max_size);
+  // Stream of file which is decompressed while it's read, empty one when
+  // file is missing. Archive isn't used while the stream exists.
+  virtual std::auto_ptr<tools::IInputStream> openFile(const fs::FilePath& file_in_archive, size_t max_size);
+  // First size bytes of file, shorter file is given as a whole. Archives
+  // decompress no more of the file than that, so headers of all files are
+  // read much faster than the files.
+  virtual tools::ByteArray getFileHead(const fs::FilePath& file_in_archive, size_t size);
+  // Heads of several files, solid archives take them in one pass instead
+  // of decoding the block from its start for every file. Result is in
+  // order of files, missing ones are empty.
+  virtual std::vector<tools::ByteArray> getFileHeads(const std::vector<fs::FilePath>& files, size_t size);
+  // Drops data decoded ahead for following requests, archive stays open.
+  // It's called before archive is kept idle.
+  virtual void releaseCaches();
 
   typedef IArchive* (*FactoryMethod)();
   static void registerArchiver(const std::string& pref_ext, FactoryMethod method);
@@ -59,4 +81,5 @@ public:
   }
 
 IArchive* recognize(const fs::FilePath& path);
+IArchive* recognize(const fs::FilePath& path, const tools::ByteArray& data);
 }
@@ -39,6 +39,18 @@ bool Image::load(const std::string& file_ext, const tools::ByteArray& buffer) {
   return DecoderFactory::getInstance().decode(file_ext, buffer, *this);
 }
 
+bool Image::load(const std::string& file_ext, const tools::ByteArray& buffer, const DecodeOptions& options) {
+  return DecoderFactory::getInstance().decode(file_ext, buffer, *this, options);
+}
+
+bool Image::load(const std::string& file_ext, tools::IInputStream& stream) {
+  return DecoderFactory::getInstance().decode(file_ext, stream, *this);
+}
+
+bool Image::load(const std::string& file_ext, tools::IInputStream& stream, const DecodeOptions& options) {
+  return DecoderFactory::getInstance().decode(file_ext, stream, *this, options);
+}
+
 Image Image::loadFrom(const tools::ByteArray& buffer) {
   Image result;
   if (result.load(buffer))
@@ -55,6 +67,10 @@ Image Image::loadFrom(const std::string& file_ext, const tools::ByteArray& buffe
   return Image::emptyImage;
 }
 
+bool Image::readSize(const std::string& file_ext, const tools::ByteArray& head, utils::Size& size) {
+  return DecoderFactory::getInstance().readSize(file_ext, head, size);
+}
+
 Image::Image()
   : enable_min_realloc_(false), depth_(0) {}
 
@@ -388,6 +404,9 @@ void copy(const img::Image& src, img::Image& dst) {
 }
 
 Image::SizeType dataSize(const img::Image& img) {
+  if (img.empty())
+    return 0;
+
   return ::dataSize(img.width(), img.height(), img.depth(), img.alignment());
 }
 
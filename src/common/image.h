@@ -12,6 +12,7 @@
 
 namespace tools {
 class ByteArray;
+class IInputStream;
 }
 
 namespace fs {
@@ -23,6 +24,8 @@ struct Rect;
 }
 
 namespace img {
+struct DecodeOptions;
+
 /*
    Class has 'copy on write' ideology, i.e.
    buffer will be copied at time when source or destination will try to change buffer.
@@ -56,9 +59,16 @@ public:
 
   bool load(const tools::ByteArray& buffer);
   bool load(const std::string& file_ext, const tools::ByteArray& buffer);
+  // Decodes while data is read, see DecoderFactory::decode()
+  bool load(const std::string& file_ext, tools::IInputStream& stream);
+  // Decodes with its own options instead of default ones of DecoderFactory
+  bool load(const std::string& file_ext, const tools::ByteArray& buffer, const DecodeOptions& options);
+  bool load(const std::string& file_ext, tools::IInputStream& stream, const DecodeOptions& options);
 
   static Image loadFrom(const tools::ByteArray& buffer);
   static Image loadFrom(const std::string& file_ext, const tools::ByteArray& buffer);
+  // Size of image without decoding it, head is the beginning of the file
+  static bool readSize(const std::string& file_ext, const tools::ByteArray& head, utils::Size& size);
 
   void create(SizeType width, SizeType height, unsigned short depth, size_t align = 1);
   void createSame(const Image& other);
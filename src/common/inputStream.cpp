@@ -0,0 +1,58 @@
+#include "inputStream.h"
+
+namespace tools {
+MemoryInputStream::MemoryInputStream(const unsigned char* data, size_t size)
+  : data_(data), size_(size) {}
+
+bool MemoryInputStream::next(const unsigned char*& data, size_t& size) {
+  if (!size_)
+    return false;
+
+  data = data_;
+  size = size_;
+  data_ += size_;
+  size_ = 0;
+  return true;
+}
+
+ByteArrayInputStream::ByteArrayInputStream(const ByteArray& array)
+  : array_(array), read_(false) {}
+
+bool ByteArrayInputStream::next(const unsigned char*& data, size_t& size) {
+  if (read_ || array_.isEmpty())
+    return false;
+
+  read_ = true;
+  data = array_.getData();
+  size = array_.getLength();
+  return true;
+}
+
+RecordingInputStream::RecordingInputStream(IInputStream& source)
+  : source_(source) {}
+
+bool RecordingInputStream::next(const unsigned char*& data, size_t& size) {
+  if (!source_.next(data, size))
+    return false;
+
+  append(recorded_, data, size);
+  return true;
+}
+
+const ByteArray& RecordingInputStream::recorded() const {
+  return recorded_;
+}
+
+ByteArray readAll(IInputStream& stream) {
+  const unsigned char* data = 0;
+  size_t size = 0;
+  if (!stream.next(data, size))
+    return ByteArray();
+
+  ByteArray result(data, size);
+  while (stream.next(data, size))
+    append(result, data, size);
+
+  return result;
+}
+}
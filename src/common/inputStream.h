@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "byteArray.h"
+
+namespace tools {
+// Data which is read chunk by chunk, so consumer starts working before the
+// whole data is produced. Chunk belongs to the stream and stays valid till
+// the next call of next().
+class IInputStream {
+public:
+  virtual ~IInputStream() {}
+
+  // False at the end of data or on error, returned chunk is never empty
+  virtual bool next(const unsigned char*& data, size_t& size) = 0;
+};
+
+// Memory which outlives the stream, given as a single chunk
+class MemoryInputStream : public IInputStream {
+public:
+  MemoryInputStream(const unsigned char* data, size_t size);
+
+  virtual bool next(const unsigned char*& data, size_t& size);
+
+private:
+  const unsigned char* data_;
+  size_t size_;
+};
+
+// Keeps reference to the array, which is given as a single chunk
+class ByteArrayInputStream : public IInputStream {
+public:
+  explicit ByteArrayInputStream(const ByteArray& array);
+
+  virtual bool next(const unsigned char*& data, size_t& size);
+
+private:
+  ByteArray array_;
+  bool read_;
+};
+
+// Passes chunks of other stream through and keeps them, so what is read
+// already is given again without producing it again
+class RecordingInputStream : public IInputStream {
+public:
+  explicit RecordingInputStream(IInputStream& source);
+
+  virtual bool next(const unsigned char*& data, size_t& size);
+
+  const ByteArray& recorded() const;
+
+private:
+  IInputStream& source_;
+  ByteArray recorded_;
+};
+
+// Rest of the stream in one array
+ByteArray readAll(IInputStream& stream);
+}
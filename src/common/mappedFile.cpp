@@ -0,0 +1,88 @@
+#include "mappedFile.h"
+
+#include <fstream>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tools {
+MappedFile::MappedFile()
+  : data_(0), size_(0), mapped_(false) {}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#ifdef __unix__
+bool MappedFile::open(const std::string& file_name) {
+  close();
+
+  const int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (-1 == fd)
+    return false;
+
+  struct stat info;
+  if (0 == fstat(fd, &info) && info.st_size > 0) {
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED != mapped) {
+      data_ = static_cast<const unsigned char*>(mapped);
+      size_ = size;
+      mapped_ = true;
+    }
+  }
+
+  // Mapping stays valid after descriptor is closed
+  ::close(fd);
+  return isOpen();
+}
+#else
+bool MappedFile::open(const std::string& file_name) {
+  close();
+
+  std::ifstream file(file_name.c_str(), std::ios::binary);
+  if (!file)
+    return false;
+
+  buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  if (!buffer_.empty()) {
+    data_ = &buffer_[0];
+    size_ = buffer_.size();
+  }
+
+  return isOpen();
+}
+#endif
+
+void MappedFile::close() {
+#ifdef __unix__
+  if (mapped_)
+    munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+
+  data_ = 0;
+  size_ = 0;
+  mapped_ = false;
+  buffer_.clear();
+}
+
+const unsigned char* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
+
+bool MappedFile::isOpen() const {
+  return 0 != data_;
+}
+
+bool MappedFile::isMapped() const {
+  return mapped_;
+}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace tools {
+// Read only view of a whole file. File is mapped to memory where mmap is
+// available and read into buffer otherwise.
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  bool open(const std::string& file_name);
+  void close();
+
+  const unsigned char* data() const;
+  size_t size() const;
+  bool isOpen() const;
+  // False when file was read into buffer
+  bool isMapped() const;
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator =(const MappedFile&);
+
+  const unsigned char* data_;
+  size_t size_;
+  bool mapped_;
+  std::vector<unsigned char> buffer_;
+};
+}
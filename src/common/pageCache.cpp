@@ -0,0 +1,119 @@
+#include "pageCache.h"
+
+#include "singleton.h"
+
+namespace manga {
+bool PageCache::KeyLess::operator ()(const Key& first, const Key& second) const {
+  if (first.path.filePath != second.path.filePath)
+    return first.path.filePath < second.path.filePath;
+
+  if (first.path.pathInArchive != second.path.pathInArchive)
+    return first.path.pathInArchive < second.path.pathInArchive;
+
+  if (first.modified != second.modified)
+    return first.modified < second.modified;
+
+  return first.decoding < second.decoding;
+}
+
+PageCache::PageCache(size_t limit)
+  : limit_(limit), size_(0) {}
+
+PageCache::~PageCache() {
+  clear();
+}
+
+PageCache& PageCache::instance() {
+  return utils::SingletonStatic<PageCache>::getInstance();
+}
+
+void PageCache::setLimit(size_t limit) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  limit_ = limit;
+  shrinkTo(limit_);
+}
+
+size_t PageCache::limit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return limit_;
+}
+
+size_t PageCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+bool PageCache::find(const Key& key, img::Image& image, std::auto_ptr<IBookCache>& cache) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Index::iterator it = index_.find(key);
+  if (index_.end() == it ||
+      (cache.get() && (!it->second->cache || it->second->cache->persistentKey() != cache->persistentKey()))) {
+    ++statistics_.misses;
+    return false;
+  }
+
+  ++statistics_.hits;
+  entries_.splice(entries_.begin(), entries_, it->second);
+
+  const Entry& entry = *it->second;
+  image = entry.image;
+  if (cache.get())
+    cache.reset(entry.cache->copy());
+
+  return true;
+}
+
+void PageCache::insert(const Key& key, const img::Image& image, const IBookCache* cache) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Index::iterator it = index_.find(key);
+  if (index_.end() != it)
+    erase(it);
+
+  const size_t size = img::dataSize(image) + (cache ? cache->memoryUsage() : 0);
+  if (size > limit_)
+    return;
+
+  shrinkTo(limit_ - size);
+
+  Entry entry(key);
+  entry.image = image;
+  entry.cache = cache ? cache->copy() : 0;
+  entry.size = size;
+
+  entries_.push_front(entry);
+  index_.insert(std::make_pair(key, entries_.begin()));
+  size_ += size;
+}
+
+void PageCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!entries_.empty())
+    erase(index_.find(entries_.back().key));
+}
+
+PageCache::Statistics PageCache::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void PageCache::resetStatistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  statistics_ = Statistics();
+}
+
+void PageCache::erase(Index::iterator it) {
+  Entries::iterator entry = it->second;
+  size_ -= entry->size;
+  delete entry->cache;
+
+  index_.erase(it);
+  entries_.erase(entry);
+}
+
+void PageCache::shrinkTo(size_t limit) {
+  while (size_ > limit) {
+    erase(index_.find(entries_.back().key));
+    ++statistics_.evictions;
+  }
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <time.h>
+
+#include "book.h"
+#include "image.h"
+
+namespace manga {
+// Decoded pages with their IBookCache results, shared by all books of
+// the process. Least recently used pages are evicted when the limit is
+// reached. Methods can be called from any thread.
+class PageCache {
+public:
+  // Page is the same only when its file isn't modified since and it's
+  // decoded the same way, so books with other settings don't get it
+  struct Key {
+    PathToFile path;
+    // Modification time of file or archive of the page
+    time_t modified;
+    // Describes options of decoding, see Book
+    std::string decoding;
+
+    Key(const PathToFile& path, time_t modified, const std::string& decoding)
+      : path(path), modified(modified), decoding(decoding) {}
+  };
+
+  struct Statistics {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+
+    Statistics()
+      : hits(0), misses(0), evictions(0) {}
+  };
+
+  // limit is in bytes, 0 disables caching
+  explicit PageCache(size_t limit = 0);
+  ~PageCache();
+
+  static PageCache& instance();
+
+  void setLimit(size_t limit);
+  size_t limit() const;
+  // Bytes taken by cached pages
+  size_t size() const;
+
+  // On hit image shares data with cached one and cache gets copy of cached
+  // result. Page cached without IBookCache result or with result of other
+  // persistent key is a miss when cache is passed.
+  bool find(const Key& key, img::Image& image, std::auto_ptr<IBookCache>& cache);
+  void insert(const Key& key, const img::Image& image, const IBookCache* cache);
+  void clear();
+
+  Statistics statistics() const;
+  void resetStatistics();
+
+private:
+  PageCache(const PageCache&);
+  PageCache& operator =(const PageCache&);
+
+  struct Entry {
+    Key key;
+    img::Image image;
+    IBookCache* cache;
+    size_t size;
+
+    explicit Entry(const Key& key)
+      : key(key), cache(0), size(0) {}
+  };
+
+  struct KeyLess {
+    bool operator ()(const Key& first, const Key& second) const;
+  };
+
+  typedef std::list<Entry> Entries;
+  typedef std::map<Key, Entries::iterator, KeyLess> Index;
+
+  void erase(Index::iterator it);
+  void shrinkTo(size_t limit);
+
+  mutable std::mutex mutex_;
+  // Most recently used pages are at front
+  Entries entries_;
+  Index index_;
+  size_t limit_;
+  size_t size_;
+  Statistics statistics_;
+};
+}
@@ -48,6 +48,9 @@ void PictureView::setBook( std::auto_ptr<manga::Book> book) {
   //image_.enableMinimumReallocations(true);
   book_ = book;
   scaler_ = new manga::CacheScaler(ScreenWidth(), ScreenHeight());
+  img::DecodeOptions decode_options = book_->decodeOptions();
+  decode_options.targetSize = scaler_->decodeSize();
+  book_->setDecodeOptions(decode_options);
   book_->setCachePrototype(scaler_);
   if( book_->toFirstFile() ) {
     draw(scaler_);
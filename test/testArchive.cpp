@@ -31,7 +31,7 @@ bool TestArchive::empty() const {
 
 //////////////////////////////////////////////////////////////////////////
 TestArchiver::TestArchiver(TestFileSystem* afs)
-  : file_system_(afs), current_archive_(0) {
+  : file_system_(afs), current_archive_(0), open_count_(0), read_count_(0), batch_count_(0), stream_count_(0), release_count_(0) {
   instance = this;
   archive::IArchive::registerArchiver(ArchExt, &TestArchiver::createProxy);
 }
@@ -43,26 +43,45 @@ TestArchiver::~TestArchiver() {
 
 const char* TestArchiver::ArchExt = "testarch";
 
+// Every proxy keeps its own archive, the archiver is shared by all of them
 class ProxyArch : public archive::IArchive {
 public:
-  ProxyArch(archive::IArchive* other)
-    : other_(other) {}
+  ProxyArch(TestArchiver* other)
+    : other_(other), archive_(0) {}
 private:
   virtual bool open(const std::string& file) {
-    return other_->open(file);
+    const bool result = other_->open(file);
+    archive_ = result ? other_->current() : 0;
+    return result;
   }
 
   virtual void close() {
+    archive_ = 0;
     return other_->close();
   }
   virtual std::vector<fs::FilePath> getFileList(bool files_only) {
+    other_->setCurrent(archive_);
     return other_->getFileList(files_only);
   }
   virtual tools::ByteArray getFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    other_->setCurrent(archive_);
     return other_->getFile(file_in_archive, max_size);
   }
+  virtual std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+    other_->setCurrent(archive_);
+    return other_->getFiles(files, max_size);
+  }
+  virtual std::auto_ptr<tools::IInputStream> openFile(const fs::FilePath& file_in_archive, size_t max_size) {
+    other_->setCurrent(archive_);
+    return other_->openFile(file_in_archive, max_size);
+  }
+  virtual void releaseCaches() {
+    other_->setCurrent(archive_);
+    other_->releaseCaches();
+  }
 
-  archive::IArchive* other_;
+  TestArchiver* other_;
+  TestArchive* archive_;
 };
 
 archive::IArchive* TestArchiver::createProxy() {
@@ -90,6 +109,7 @@ bool TestArchiver::open(const std::string& file) {
   for (; it != itEnd; ++it) {
     if (it->getName() == path.getFileName()) {
       current_archive_ = &(*it);
+      ++open_count_;
       return true;
     }
   }
@@ -110,6 +130,7 @@ std::vector<fs::FilePath> TestArchiver::getFileList(bool files_only) {
 
 tools::ByteArray TestArchiver::getFile(const fs::FilePath& file_in_archive, size_t max_size) {
   tools::ByteArray result;
+  ++read_count_;
 
   if (current_archive_) {
     TestArchive::Content::iterator it = current_archive_->getContent().find(file_in_archive);
@@ -119,4 +140,46 @@ tools::ByteArray TestArchiver::getFile(const fs::FilePath& file_in_archive, size
 
   return result;
 }
+
+std::vector<tools::ByteArray> TestArchiver::getFiles(const std::vector<fs::FilePath>& files, size_t max_size) {
+  ++batch_count_;
+  return archive::IArchive::getFiles(files, max_size);
+}
+
+std::auto_ptr<tools::IInputStream> TestArchiver::openFile(const fs::FilePath& file_in_archive, size_t max_size) {
+  ++stream_count_;
+  return archive::IArchive::openFile(file_in_archive, max_size);
+}
+
+void TestArchiver::releaseCaches() {
+  ++release_count_;
+}
+
+TestArchive* TestArchiver::current() const {
+  return current_archive_;
+}
+
+void TestArchiver::setCurrent(TestArchive* archive) {
+  current_archive_ = archive;
+}
+
+size_t TestArchiver::openCount() const {
+  return open_count_;
+}
+
+size_t TestArchiver::readCount() const {
+  return read_count_;
+}
+
+size_t TestArchiver::batchCount() const {
+  return batch_count_;
+}
+
+size_t TestArchiver::streamCount() const {
+  return stream_count_;
+}
+
+size_t TestArchiver::releaseCount() const {
+  return release_count_;
+}
 }
@@ -39,6 +39,11 @@ class TestFileSystem;
 class TestArchiver: public archive::IArchive {
   TestFileSystem *file_system_;
   TestArchive *current_archive_;
+  size_t open_count_;
+  size_t read_count_;
+  size_t batch_count_;
+  size_t stream_count_;
+  size_t release_count_;
 
   static TestArchiver *instance;
   static archive::IArchive *createProxy();
@@ -52,6 +57,22 @@ public:
   void close();
   std::vector<fs::FilePath> getFileList(bool files_only);
   tools::ByteArray getFile(const fs::FilePath &file_in_archive, size_t max_size);
+  std::vector<tools::ByteArray> getFiles(const std::vector<fs::FilePath> &files, size_t max_size);
+  std::auto_ptr<tools::IInputStream> openFile(const fs::FilePath &file_in_archive, size_t max_size);
+  void releaseCaches();
+
+  TestArchive *current() const;
+  void setCurrent(TestArchive *archive);
+  // Number of successful open() calls
+  size_t openCount() const;
+  // Number of getFile() calls, files of getFiles() are counted too
+  size_t readCount() const;
+  // Number of getFiles() calls
+  size_t batchCount() const;
+  // Number of openFile() calls
+  size_t streamCount() const;
+  // Number of releaseCaches() calls
+  size_t releaseCount() const;
 };
 }
 
@@ -1,14 +1,175 @@
 #include <boost/test/unit_test.hpp>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+
 #include "common/iArchive.h"
+#include "common/archives/7zArchive.h"
+#include "common/archives/zipArchive.h"
+#include "common/image.h"
+#include "testBenchmark.h"
 
 namespace {
+void AppendLE(std::string& out, unsigned long value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+std::string Deflate(const std::string& text)
+{
+    z_stream stream = z_stream();
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string result(deflateBound(&stream, text.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = text.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+    stream.avail_out = result.size();
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+// Packed streams of 7z lie between the signature header and the next
+// header, they are wiped in memory which an archive opened from it shares
+void WipePackedStreams(const tools::ByteArray& data)
+{
+    BOOST_REQUIRE_GT(data.getSize(), 20U);
+    unsigned long long packed_size = 0;
+    for (int i = 7; i >= 0; --i)
+        packed_size = (packed_size << 8) | data[12 + i];
+
+    BOOST_REQUIRE_LE(32 + packed_size, data.getSize());
+    memset(const_cast<unsigned char*>(data.getData()) + 32, 0, packed_size);
+}
+
+typedef std::vector<std::pair<std::string, std::string> > ZipEntries;
+
+// Zip of given names and contents
+std::string CreateZip(const ZipEntries& entries, bool deflated)
+{
+    std::string data;
+    std::string directory;
+    const int count = static_cast<int>(entries.size());
+    for (int i = 0; i < count; ++i) {
+        const std::string& name = entries[i].first;
+        const std::string& text = entries[i].second;
+        const std::string stored = deflated ? Deflate(text) : text;
+        const int method = deflated ? Z_DEFLATED : 0;
+        const unsigned long crc = crc32(0, reinterpret_cast<const Bytef*>(text.data()), text.size());
+        const unsigned long offset = data.size();
+
+        AppendLE(data, 0x04034b50, 4);
+        AppendLE(data, 20, 2);
+        AppendLE(data, 0, 2);
+        AppendLE(data, method, 2);
+        AppendLE(data, 0, 4);
+        AppendLE(data, crc, 4);
+        AppendLE(data, stored.size(), 4);
+        AppendLE(data, text.size(), 4);
+        AppendLE(data, name.size(), 2);
+        AppendLE(data, 0, 2);
+        data += name;
+        data += stored;
+
+        AppendLE(directory, 0x02014b50, 4);
+        AppendLE(directory, 20, 2);
+        AppendLE(directory, 20, 2);
+        AppendLE(directory, 0, 2);
+        AppendLE(directory, method, 2);
+        AppendLE(directory, 0, 4);
+        AppendLE(directory, crc, 4);
+        AppendLE(directory, stored.size(), 4);
+        AppendLE(directory, text.size(), 4);
+        AppendLE(directory, name.size(), 2);
+        AppendLE(directory, 0, 2);
+        AppendLE(directory, 0, 2);
+        AppendLE(directory, 0, 2);
+        AppendLE(directory, 0, 2);
+        AppendLE(directory, 0, 4);
+        AppendLE(directory, offset, 4);
+        directory += name;
+    }
+
+    const unsigned long directory_offset = data.size();
+    data += directory;
+    AppendLE(data, 0x06054b50, 4);
+    AppendLE(data, 0, 2);
+    AppendLE(data, 0, 2);
+    AppendLE(data, count, 2);
+    AppendLE(data, count, 2);
+    AppendLE(data, directory.size(), 4);
+    AppendLE(data, directory_offset, 4);
+    AppendLE(data, 0, 2);
+    return data;
+}
+
+// Zip with entries "page <i>.txt" containing "text <i>" repeated
+std::string CreateZip(int count, bool deflated = false, int repeat = 1)
+{
+    ZipEntries entries;
+    for (int i = 0; i < count; ++i) {
+        std::ostringstream name;
+        name << "page " << i << ".txt";
+        std::ostringstream content;
+        for (int j = 0; j < repeat; ++j)
+            content << "text " << i;
+        entries.push_back(std::make_pair(name.str(), content.str()));
+    }
+
+    return CreateZip(entries, deflated);
+}
+
 struct ArchiverFixture
 {
+    ~ArchiverFixture()
+    {
+        if (!temp_zip_.empty())
+            unlink(temp_zip_.c_str());
+    }
+
+    std::string WriteTempZip(const std::string& data)
+    {
+        char name[] = "/tmp/pocketmanga_zip_XXXXXX";
+        const int fd = mkstemp(name);
+        BOOST_REQUIRE(fd != -1);
+        close(fd);
+        temp_zip_ = std::string(name) + ".zip";
+        BOOST_REQUIRE(0 == rename(name, temp_zip_.c_str()));
+
+        std::ofstream out(temp_zip_.c_str(), std::ios::binary);
+        out.write(data.data(), data.size());
+        return temp_zip_;
+    }
+
     void CheckSimpleArchive(const std::string& path)
     {
         fs::FilePath file_path(path, true);
-        archive::IArchive* opened_archive = archive::recognize(file_path);
+        CheckSimpleArchive(archive::recognize(file_path));
+    }
+
+    // Archive is read from memory without file
+    void CheckMemoryArchive(const std::string& path)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        BOOST_REQUIRE(!data.empty());
+
+        const fs::FilePath name(fs::FilePath(path, true).getName(), true);
+        CheckSimpleArchive(archive::recognize(name, tools::toByteArray(data)));
+    }
+
+    void CheckSimpleArchive(archive::IArchive* opened_archive)
+    {
         BOOST_REQUIRE(opened_archive);
         std::vector<fs::FilePath> paths = opened_archive->getFileList(true);
         std::sort(paths.begin(), paths.end());
@@ -17,7 +178,62 @@ struct ArchiverFixture
                          fs::FilePath("file1.txt", true),
                          fs::FilePath("file2.txt", true)};
         BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), paths.begin(), paths.end());
+
+        CheckFile(*opened_archive, "file1.txt", "text1\n");
+        CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+
+        // Too large file isn't extracted
+        BOOST_CHECK(opened_archive->getFile(fs::FilePath("file2.txt", true), 5).isEmpty());
+        BOOST_CHECK(opened_archive->getFile(fs::FilePath("missing.txt", true), 100).isEmpty());
+        delete opened_archive;
+    }
+
+    // Items of solid block are kept after the first request
+    void CheckAnyOrder(const std::string& path)
+    {
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        CheckFile(*opened_archive, "file2.txt", "text2\n");
+        CheckFile(*opened_archive, "file1.txt", "text1\n");
+        CheckFile(*opened_archive, "file2.txt", "text2\n");
+        CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+        CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+        CheckFile(*opened_archive, "file1.txt", "text1\n");
+    }
+
+    // Files are returned in requested order whatever order archive has
+    void CheckBatch(const std::string& path)
+    {
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        std::vector<fs::FilePath> files;
+        files.push_back(fs::FilePath("content/file3.txt", true));
+        files.push_back(fs::FilePath("file1.txt", true));
+        files.push_back(fs::FilePath("missing.txt", true));
+        files.push_back(fs::FilePath("file1.txt", true));
+        const std::vector<tools::ByteArray> data = opened_archive->getFiles(files, 100);
+        BOOST_REQUIRE_EQUAL(data.size(), files.size());
+        BOOST_CHECK_EQUAL(tools::byteArray2string(data[0]), "text3\n");
+        BOOST_CHECK_EQUAL(tools::byteArray2string(data[1]), "text1\n");
+        BOOST_CHECK(data[2].isEmpty());
+        BOOST_CHECK_EQUAL(tools::byteArray2string(data[3]), "text1\n");
+
+        // Single reads are not affected
+        CheckFile(*opened_archive, "file2.txt", "text2\n");
+        CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+
+        BOOST_CHECK(opened_archive->getFiles(files, 1)[0].isEmpty());
     }
+
+    void CheckFile(archive::IArchive& opened_archive, const std::string& path, const std::string& expected)
+    {
+        const tools::ByteArray data = opened_archive.getFile(fs::FilePath(path, true), 100);
+        BOOST_CHECK_EQUAL(tools::byteArray2string(data), expected);
+    }
+
+    std::string temp_zip_;
 };
 
 // --log_level=test_suite --run_test=TestArchiver
@@ -39,6 +255,344 @@ BOOST_AUTO_TEST_CASE(SevenZip) {
     CheckSimpleArchive("test_data/archives/archive.7z");
 }
 
+BOOST_AUTO_TEST_CASE(SevenZip_AnyOrder) {
+    CheckAnyOrder("test_data/archives/archive.7z");
+}
+
+BOOST_AUTO_TEST_CASE(Rar_AnyOrder) {
+    CheckAnyOrder("test_data/archives/archive.rar");
+}
+
+BOOST_AUTO_TEST_CASE(Zip_Batch) {
+    CheckBatch("test_data/archives/archive.zip");
+}
+
+BOOST_AUTO_TEST_CASE(SevenZip_Batch) {
+    CheckBatch("test_data/archives/archive.7z");
+}
+
+BOOST_AUTO_TEST_CASE(Rar_Batch) {
+    CheckBatch("test_data/archives/archive.rar");
+}
+
+// Entries are found without walking central directory
+BOOST_AUTO_TEST_CASE(Zip_ManyEntries) {
+    const int Count = 10000;
+    const std::string path = WriteTempZip(CreateZip(Count));
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+    BOOST_REQUIRE(opened_archive.get());
+
+    // Index is built on demand when list is taken from catalog
+    CheckFile(*opened_archive, "page 9999.txt", "text 9999");
+    BOOST_CHECK_EQUAL(opened_archive->getFileList(true).size(), Count);
+
+    BENCHMARK("ZipArchive::getFile, 10000 entries") {
+        for (int i = Count - 1; i >= 0; --i) {
+            std::ostringstream entry;
+            entry << "page " << i << ".txt";
+            BOOST_REQUIRE(!opened_archive->getFile(fs::FilePath(entry.str(), true), 100).isEmpty());
+        }
+    }
+
+    CheckFile(*opened_archive, "page 0.txt", "text 0");
+    CheckFile(*opened_archive, "page 5000.txt", "text 5000");
+    BOOST_CHECK(opened_archive->getFile(fs::FilePath("page 10000.txt", true), 100).isEmpty());
+}
+
+// Deflated entries are inflated from mapped file
+BOOST_AUTO_TEST_CASE(Zip_Deflated) {
+    const std::string path = WriteTempZip(CreateZip(3, true, 1000));
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+    BOOST_REQUIRE(opened_archive.get());
+
+    std::string expected;
+    for (int i = 0; i < 1000; ++i)
+        expected += "text 1";
+
+    const tools::ByteArray data = opened_archive->getFile(fs::FilePath("page 1.txt", true), expected.size());
+    BOOST_CHECK(tools::byteArray2string(data) == expected);
+    BOOST_CHECK(opened_archive->getFile(fs::FilePath("page 1.txt", true), expected.size() - 1).isEmpty());
+
+    std::vector<fs::FilePath> files;
+    files.push_back(fs::FilePath("page 2.txt", true));
+    files.push_back(fs::FilePath("page 0.txt", true));
+    const std::vector<tools::ByteArray> batch = opened_archive->getFiles(files, expected.size());
+    BOOST_REQUIRE_EQUAL(batch.size(), 2);
+    BOOST_CHECK_EQUAL(batch[0].getSize(), expected.size());
+    BOOST_CHECK_EQUAL(tools::byteArray2string(batch[1], 0, 7), "text 0t");
+}
+
+// Entries read together are inflated on several threads
+BOOST_AUTO_TEST_CASE(Zip_Parallel) {
+    const int Count = 16;
+    const std::string path = WriteTempZip(CreateZip(Count, true, 1000));
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+    BOOST_REQUIRE(opened_archive.get());
+
+    std::vector<fs::FilePath> files;
+    for (int i = Count - 1; i >= 0; --i) {
+        std::ostringstream entry;
+        entry << "page " << i << ".txt";
+        files.push_back(fs::FilePath(entry.str(), true));
+    }
+    files.push_back(files.front());
+
+    const size_t threads[] = {1, 4};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+        archive::setZipThreads(threads[t]);
+        const std::vector<tools::ByteArray> data = opened_archive->getFiles(files, 100000);
+        BOOST_REQUIRE_EQUAL(data.size(), files.size());
+        for (size_t i = 0; i < data.size(); ++i) {
+            std::ostringstream expected;
+            for (int j = 0; j < 1000; ++j)
+                expected << "text " << (i < Count ? Count - 1 - i : Count - 1);
+            BOOST_CHECK(tools::byteArray2string(data[i]) == expected.str());
+        }
+    }
+    archive::setZipThreads(0);
+}
+
+// Entries are decompressed by chunks while they are read
+BOOST_AUTO_TEST_CASE(Zip_Stream) {
+    const int Repeat = 20000;
+    const bool deflated[] = {false, true};
+    for (size_t d = 0; d < sizeof(deflated) / sizeof(deflated[0]); ++d) {
+        const std::string path = WriteTempZip(CreateZip(3, deflated[d], Repeat));
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        std::string expected;
+        for (int i = 0; i < Repeat; ++i)
+            expected += "text 2";
+
+        std::auto_ptr<tools::IInputStream> stream = opened_archive->openFile(fs::FilePath("page 2.txt", true), expected.size());
+        BOOST_REQUIRE(stream.get());
+
+        std::string data;
+        size_t chunks = 0;
+        const unsigned char* chunk = 0;
+        size_t size = 0;
+        while (stream->next(chunk, size)) {
+            data.append(chunk, chunk + size);
+            ++chunks;
+        }
+        BOOST_CHECK(data == expected);
+        // Stored entry is given right from mapped file
+        BOOST_CHECK(deflated[d] ? chunks > 1 : chunks == 1);
+        stream.reset();
+
+        BOOST_CHECK(!opened_archive->openFile(fs::FilePath("page 2.txt", true), expected.size() - 1).get());
+        BOOST_CHECK(!opened_archive->openFile(fs::FilePath("missing.txt", true), expected.size()).get());
+        // Archive is used as usual after stream is closed
+        const tools::ByteArray other = opened_archive->getFile(fs::FilePath("page 0.txt", true), expected.size());
+        BOOST_CHECK_EQUAL(tools::byteArray2string(other, 0, 7), "text 0t");
+        unlink(path.c_str());
+    }
+
+    // Archives without streaming give the whole file
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath("test_data/archives/archive.7z", true)));
+    BOOST_REQUIRE(opened_archive.get());
+    std::auto_ptr<tools::IInputStream> stream = opened_archive->openFile(fs::FilePath("file1.txt", true), 100);
+    BOOST_REQUIRE(stream.get());
+    BOOST_CHECK_EQUAL(tools::byteArray2string(tools::readAll(*stream)), "text1\n");
+}
+
+// Every file of the archive is a separate block
+BOOST_AUTO_TEST_CASE(SevenZip_Blocks) {
+    CheckSimpleArchive("test_data/archives/archive_blocks.7z");
+
+    archive::setSevenZipThreads(1);
+    CheckBatch("test_data/archives/archive_blocks.7z");
+    archive::setSevenZipThreads(3);
+    CheckBatch("test_data/archives/archive_blocks.7z");
+    CheckBatch("test_data/archives/archive.7z");
+    archive::setSevenZipThreads(0);
+    BOOST_CHECK_GE(archive::sevenZipThreads(), 1U);
+}
+
+// Items of solid block decoded with the requested one are kept for
+// following requests
+BOOST_AUTO_TEST_CASE(SevenZip_SolidCache) {
+    std::ifstream file("test_data/archives/archive.7z", std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const tools::ByteArray data = tools::toByteArray(content);
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath("archive.7z", true), data));
+    BOOST_REQUIRE(opened_archive.get());
+    CheckFile(*opened_archive, "file1.txt", "text1\n");
+
+    // Anything decoded once again is broken now
+    WipePackedStreams(data);
+
+    CheckFile(*opened_archive, "file2.txt", "text2\n");
+    CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+    // Given item isn't kept, so the block is decoded again
+    const tools::ByteArray broken = opened_archive->getFile(fs::FilePath("file1.txt", true), 100);
+    BOOST_CHECK_NE(tools::byteArray2string(broken), "text1\n");
+}
+
+// Decoded items are dropped before archive is kept idle
+BOOST_AUTO_TEST_CASE(SevenZip_ReleaseCaches) {
+    std::ifstream file("test_data/archives/archive.7z", std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const tools::ByteArray data = tools::toByteArray(content);
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath("archive.7z", true), data));
+    BOOST_REQUIRE(opened_archive.get());
+    CheckFile(*opened_archive, "file1.txt", "text1\n");
+    opened_archive->releaseCaches();
+
+    WipePackedStreams(data);
+
+    const tools::ByteArray broken = opened_archive->getFile(fs::FilePath("file2.txt", true), 100);
+    BOOST_CHECK_NE(tools::byteArray2string(broken), "text2\n");
+}
+
+BOOST_AUTO_TEST_CASE(Memory) {
+    CheckMemoryArchive("test_data/archives/archive.zip");
+    CheckMemoryArchive("test_data/archives/archive.7z");
+    CheckMemoryArchive("test_data/archives/archive.rar");
+    CheckMemoryArchive("test_data/archives/archive.tar");
+
+    // Worker threads read the same memory
+    archive::setSevenZipThreads(3);
+    CheckMemoryArchive("test_data/archives/archive_blocks.7z");
+    archive::setSevenZipThreads(0);
+
+    // Zip entries are decoded right from the buffer
+    const std::string zip = CreateZip(3, true, 1000);
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath("nested.zip", true), tools::toByteArray(zip)));
+    BOOST_REQUIRE(opened_archive.get());
+    BOOST_CHECK_EQUAL(opened_archive->getFileList(true).size(), 3);
+    const tools::ByteArray data = opened_archive->getFile(fs::FilePath("page 1.txt", true), 6000);
+    BOOST_CHECK_EQUAL(data.getSize(), 6000);
+    BOOST_CHECK_EQUAL(tools::byteArray2string(data, 0, 7), "text 1t");
+
+    BOOST_CHECK(!archive::recognize(fs::FilePath("broken.zip", true), tools::toByteArray("not an archive")));
+}
+
+// Only the beginning of file is decompressed
+BOOST_AUTO_TEST_CASE(FileHead) {
+    const bool deflated[] = {false, true};
+    for (size_t d = 0; d < sizeof(deflated) / sizeof(deflated[0]); ++d) {
+        const std::string path = WriteTempZip(CreateZip(3, deflated[d], 1000));
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(path, true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        const fs::FilePath page("page 1.txt", true);
+        BOOST_CHECK_EQUAL(tools::byteArray2string(opened_archive->getFileHead(page, 7)), "text 1t");
+        BOOST_CHECK_EQUAL(opened_archive->getFileHead(page, 100000).getSize(), 6000);
+        BOOST_CHECK(opened_archive->getFileHead(fs::FilePath("missing.txt", true), 7).isEmpty());
+        BOOST_CHECK_EQUAL(opened_archive->getFile(page, 6000).getSize(), 6000);
+        unlink(path.c_str());
+    }
+
+    const char* archives[] = {"test_data/archives/archive.7z", "test_data/archives/archive_blocks.7z",
+                              "test_data/archives/archive.rar", "test_data/archives/archive.tar"};
+    for (size_t i = 0; i < sizeof(archives) / sizeof(archives[0]); ++i) {
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(archives[i], true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        const fs::FilePath file("content/file3.txt", true);
+        BOOST_CHECK_EQUAL(tools::byteArray2string(opened_archive->getFileHead(file, 4)), "text");
+        BOOST_CHECK_EQUAL(tools::byteArray2string(opened_archive->getFileHead(file, 100)), "text3\n");
+        BOOST_CHECK(opened_archive->getFileHead(fs::FilePath("missing.txt", true), 4).isEmpty());
+        // Aborted extraction doesn't affect the next ones
+        CheckFile(*opened_archive, "file2.txt", "text2\n");
+        BOOST_CHECK_EQUAL(tools::byteArray2string(opened_archive->getFileHead(fs::FilePath("file2.txt", true), 4)), "text");
+        CheckFile(*opened_archive, "content/file3.txt", "text3\n");
+    }
+}
+
+// Sizes of pages are taken from their headers without decoding
+BOOST_AUTO_TEST_CASE(PageSizes) {
+    const char* files[] = {"pngs/hor_1200x600.png", "pngs/hor_1200x900.png", "pngs/hor_800x600.png",
+                           "pngs/ver_600x1200.png", "pngs/ver_600x800.png", "pngs/ver_900x1200.png",
+                           "bmp/valid/8bpp-320x240.bmp", "bmp/valid/24bpp-320x240.bmp"};
+    ZipEntries entries;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        std::ifstream file((std::string("test_data/") + files[i]).c_str(), std::ios::binary);
+        const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        BOOST_REQUIRE(!data.empty());
+        entries.push_back(std::make_pair(files[i], data));
+    }
+
+    std::vector<fs::FilePath> pages;
+    for (size_t i = 0; i < entries.size(); ++i)
+        pages.push_back(fs::FilePath(entries[i].first, true));
+
+    // Solid 7z of the same files
+    const std::string paths[] = {WriteTempZip(CreateZip(entries, true)), "test_data/archives/pages.7z"};
+    const size_t HeadSize = 2048;
+    for (size_t a = 0; a < sizeof(paths) / sizeof(paths[0]); ++a) {
+        std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(paths[a], true)));
+        BOOST_REQUIRE(opened_archive.get());
+
+        const std::vector<tools::ByteArray> heads = opened_archive->getFileHeads(pages, HeadSize);
+        BOOST_REQUIRE_EQUAL(heads.size(), pages.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const fs::FilePath& page = pages[i];
+            img::Image image;
+            BOOST_REQUIRE(image.load(page.getExtension(), opened_archive->getFile(page, entries[i].second.size())));
+
+            utils::Size size;
+            BOOST_CHECK(img::Image::readSize(page.getExtension(), opened_archive->getFileHead(page, HeadSize), size));
+            BOOST_CHECK_MESSAGE(size.width == image.width() && size.height == image.height(), paths[a] << ": " << entries[i].first);
+
+            size = utils::Size();
+            BOOST_CHECK(img::Image::readSize(page.getExtension(), heads[i], size));
+            BOOST_CHECK_MESSAGE(size.width == image.width() && size.height == image.height(), paths[a] << ": " << entries[i].first);
+        }
+    }
+
+    std::auto_ptr<archive::IArchive> solid_archive(archive::recognize(fs::FilePath(paths[1], true)));
+    BOOST_REQUIRE(solid_archive.get());
+    BENCHMARK("Sizes of 8 pages of solid 7z from heads read one by one, 20 times") {
+        for (int n = 0; n < 20; ++n) {
+            for (size_t i = 0; i < pages.size(); ++i) {
+                utils::Size size;
+                BOOST_REQUIRE(img::Image::readSize(pages[i].getExtension(), solid_archive->getFileHead(pages[i], HeadSize), size));
+            }
+        }
+    }
+
+    BENCHMARK("Sizes of 8 pages of solid 7z from heads read together, 20 times") {
+        for (int n = 0; n < 20; ++n) {
+            const std::vector<tools::ByteArray> heads = solid_archive->getFileHeads(pages, HeadSize);
+            for (size_t i = 0; i < pages.size(); ++i) {
+                utils::Size size;
+                BOOST_REQUIRE(img::Image::readSize(pages[i].getExtension(), heads[i], size));
+            }
+        }
+    }
+
+    std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(fs::FilePath(paths[0], true)));
+    BOOST_REQUIRE(opened_archive.get());
+    BENCHMARK("Sizes of 8 zipped pages from their heads, 100 times") {
+        for (int n = 0; n < 100; ++n) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const fs::FilePath page(entries[i].first, true);
+                utils::Size size;
+                BOOST_REQUIRE(img::Image::readSize(page.getExtension(), opened_archive->getFileHead(page, HeadSize), size));
+            }
+        }
+    }
+}
+
+// Timings are only comparable on an optimized build, take the median of several runs
+BOOST_AUTO_TEST_CASE(SevenZip_Open) {
+    const fs::FilePath path("test_data/archives/archive.7z", true);
+    BENCHMARK("SevenZipArchive::open, 1000 times") {
+        for (int i = 0; i < 1000; ++i) {
+            std::auto_ptr<archive::IArchive> opened_archive(archive::recognize(path));
+            BOOST_REQUIRE(opened_archive.get());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(Tar) {
     CheckSimpleArchive("test_data/archives/archive.tar");
 }
@@ -18,7 +18,9 @@ namespace {
 class BmpFixture {
 protected:
   BmpFixture() {
-    img::DecoderFactory::getInstance().setAlignment(4);
+    img::DecodeOptions options = img::DecoderFactory::getInstance().getDefaultOptions();
+    options.alignment = 4;
+    img::DecoderFactory::getInstance().setDefaultOptions(options);
   }
 
   std::string printColor(const color::Rgba& color1) {
@@ -1,9 +1,16 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
 
+#include <algorithm>
+#include <sstream>
+
 #include "book.h"
+#include "catalog.h"
 #include "image.h"
+#include "pageCache.h"
+#include "common/decoders/imgDecoderFactory.h"
 
+#include "testBenchmark.h"
 #include "testFileSystem.h"
 #include "testImageDecoder.h"
 
@@ -210,6 +217,25 @@ public:
     BOOST_CHECK_EQUAL(i, iter_images_.size());
   }
 
+  void DoPreviousIterationTest(manga::Book& book, bool with_preload) {
+    BOOST_REQUIRE(book.toFirstFile());
+    while (book.incrementPosition()) {
+      if (with_preload)
+        book.preload();
+    }
+
+    size_t i = iter_images_.size();
+    do {
+      if (with_preload)
+        book.preload();
+
+      BOOST_REQUIRE_GT(i, 0U);
+      BOOST_CHECK_EQUAL(iter_images_[--i], DataFromTestImage(book.currentImage()));
+    } while (book.decrementPosition());
+
+    BOOST_CHECK_EQUAL(i, 0);
+  }
+
   void DoNextIterationTest(manga::BookExplorer& explorer) {
     BOOST_REQUIRE(explorer.toFirstFile());
     size_t i = 0;
@@ -410,6 +436,196 @@ BOOST_FIXTURE_TEST_CASE(ExplorerIteratePrevious_File_ArchivesOnly, ExplorerTestF
   DoPreviousIterationTest(explorer);
 }
 
+// Files of archive are read ahead in batches
+BOOST_FIXTURE_TEST_CASE(ExplorerRead_File_ArchivesOnly, ExplorerTestFixture) {
+  Construct(true, false);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(explorer.toFirstFile());
+  size_t reads = archiver_.readCount();
+  size_t batches = archiver_.batchCount();
+  size_t i = 0;
+  do {
+    BOOST_REQUIRE_LT(i, iter_images_.size());
+    BOOST_CHECK_EQUAL(tools::byteArray2string(CreateTestImage(iter_images_[i++])),
+                      tools::byteArray2string(explorer.readCurrentFile()));
+  } while (explorer.toNextFile());
+  BOOST_CHECK_EQUAL(i, iter_images_.size());
+  // Every file is decompressed once
+  BOOST_CHECK_EQUAL(archiver_.readCount() - reads, iter_images_.size());
+  BOOST_CHECK_LT(archiver_.batchCount() - batches, iter_images_.size());
+
+  // Files are read ahead backward too
+  reads = archiver_.readCount();
+  batches = archiver_.batchCount();
+  BOOST_REQUIRE(explorer.toLastFile());
+  do {
+    BOOST_REQUIRE_GT(i, 0U);
+    BOOST_CHECK_EQUAL(tools::byteArray2string(CreateTestImage(iter_images_[--i])),
+                      tools::byteArray2string(explorer.readCurrentFile()));
+  } while (explorer.toPreviousFile());
+  BOOST_CHECK_EQUAL(i, 0);
+  BOOST_CHECK_EQUAL(archiver_.readCount() - reads, iter_images_.size());
+  BOOST_CHECK_LT(archiver_.batchCount() - batches, iter_images_.size());
+}
+
+// Files read ahead are kept when reading turns back
+BOOST_FIXTURE_TEST_CASE(ExplorerRead_File_TurnBack, ExplorerTestFixture) {
+  Construct(true, false);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(explorer.toFirstFile());
+  BOOST_REQUIRE(explorer.toNextFile());
+  explorer.readCurrentFile();
+  const size_t reads = archiver_.readCount();
+
+  BOOST_REQUIRE(explorer.toPreviousFile());
+  BOOST_CHECK_EQUAL(tools::byteArray2string(CreateTestImage(iter_images_[0])),
+                    tools::byteArray2string(explorer.readCurrentFile()));
+  BOOST_REQUIRE(explorer.toNextFile());
+  BOOST_REQUIRE(explorer.toNextFile());
+  BOOST_CHECK_EQUAL(tools::byteArray2string(CreateTestImage(iter_images_[2])),
+                    tools::byteArray2string(explorer.readCurrentFile()));
+  BOOST_CHECK_EQUAL(archiver_.readCount() - reads, 1U);
+}
+
+// Pages of archive are decompressed once, the current one is streamed
+// and the following ones are read in batches
+BOOST_FIXTURE_TEST_CASE(BookRead_Archive_Batches, ExplorerTestFixture) {
+  Construct(true, false);
+
+  manga::Book book(releaseFileSystem());
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  const size_t reads = archiver_.readCount();
+  const size_t streams = archiver_.streamCount();
+  const size_t batches = archiver_.batchCount();
+  DoNextIterationTest(book, true);
+
+  BOOST_CHECK_EQUAL(archiver_.readCount() - reads, iter_images_.size());
+  BOOST_CHECK_GT(archiver_.batchCount() - batches, 0U);
+  BOOST_CHECK_LT(archiver_.streamCount() - streams, iter_images_.size() / 2);
+}
+
+// Page which isn't an image of its extension is decompressed once too
+BOOST_FIXTURE_TEST_CASE(BookRead_Archive_NotImage, ExplorerTestFixture) {
+  addArchive("/path/to/archive.testarch");
+  current_archive_.addFile("page1.testimg", tools::toByteArray("not an image"));
+  addFileToArchive("page2.testimg", "Image File 2");
+  commitArchive();
+
+  manga::Book book(releaseFileSystem());
+  book.setRoot(fs::FilePath("/path/to/", false));
+  BOOST_REQUIRE(book.toFirstFile());
+  BOOST_CHECK_EQUAL("Image File 2", DataFromTestImage(book.currentImage()));
+  BOOST_CHECK_EQUAL(archiver_.readCount(), 2U);
+}
+
+// Pages are decoded with options of the book, default ones of factory stay as they are
+BOOST_FIXTURE_TEST_CASE(BookRead_DecodeOptions, ExplorerTestFixture) {
+  Construct(false, true);
+
+  manga::Book book(releaseFileSystem());
+  img::DecodeOptions options = book.decodeOptions();
+  BOOST_CHECK_EQUAL(options.region.width, 0U);
+  options.region = utils::Rect(6, 0, 4, 1);
+  book.setDecodeOptions(options);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(book.toFirstFile());
+  BOOST_CHECK_EQUAL("File", DataFromTestImage(book.currentImage()));
+  BOOST_CHECK_EQUAL(img::DecoderFactory::getInstance().getDefaultOptions().region.width, 0U);
+
+  // Loaded pages are decoded again
+  options.region = utils::Rect(0, 0, 5, 1);
+  book.setDecodeOptions(options);
+  BOOST_CHECK_EQUAL("Image", DataFromTestImage(book.currentImage()));
+  BOOST_REQUIRE(book.incrementPosition());
+  BOOST_CHECK_EQUAL("Image", DataFromTestImage(book.currentImage()));
+}
+
+// Archives are not opened again when explorer returns to them
+BOOST_FIXTURE_TEST_CASE(ExplorerEnter_ArchivePool, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  BOOST_REQUIRE(explorer.setRoot(fs::FilePath("/path/to/", false)));
+
+  const manga::PathToFile first(fs::FilePath("/path/to/dir_11/archive1.testarch", true),
+                                fs::FilePath("/arc/path 1/file2.testimg", true));
+  const manga::PathToFile second(fs::FilePath("/path/to/dir_100/subdir 101/archive1.testarch", true),
+                                 fs::FilePath("file1.testimg", true));
+  const manga::PathToFile file(fs::FilePath("/path/to/dir_2/file1.testimg", true));
+  const size_t opened = archiver_.openCount();
+
+  for (int i = 0; i < 3; ++i) {
+    BOOST_REQUIRE(explorer.enter(first));
+    BOOST_CHECK_EQUAL(explorer.getCurrentPos(), first);
+    BOOST_CHECK_EQUAL(tools::byteArray2string(explorer.readCurrentFile()),
+                      tools::byteArray2string(CreateTestImage("Image File 5")));
+
+    BOOST_REQUIRE(explorer.enter(second));
+    BOOST_CHECK_EQUAL(tools::byteArray2string(explorer.readCurrentFile()),
+                      tools::byteArray2string(CreateTestImage("Image File 14")));
+
+    BOOST_REQUIRE(explorer.enter(file));
+    BOOST_CHECK_EQUAL(explorer.getCurrentPos(), file);
+  }
+
+  BOOST_CHECK_EQUAL(archiver_.openCount() - opened, 2);
+  // Caches of archives are dropped while they are idle
+  BOOST_CHECK_GE(archiver_.releaseCount(), 5U);
+}
+
+// Archive is kept in pool only when it's known whether it's modified
+class NoTimeFileSystem: public fs::IFileManager {
+public:
+  explicit NoTimeFileSystem(fs::IFileManager* file_mgr)
+    : file_mgr_(file_mgr) {}
+
+  virtual std::vector<fs::FilePath> getFileList(const fs::FilePath& root, EntryTypes entries, bool recursive) {
+    return file_mgr_->getFileList(root, entries, recursive);
+  }
+
+  virtual tools::ByteArray readFile(const fs::FilePath& file, size_t max_size) {
+    return file_mgr_->readFile(file, max_size);
+  }
+
+  virtual bool getModificationTime(const fs::FilePath& /*file*/, time_t& time) {
+    time = 0;
+    return false;
+  }
+
+  fs::IFileManager* file_mgr_;
+};
+
+BOOST_FIXTURE_TEST_CASE(ExplorerEnter_ArchivePool_NoTime, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(new NoTimeFileSystem(file_system_.get()), fs::IFileManager::File);
+  BOOST_REQUIRE(explorer.setRoot(fs::FilePath("/path/to/", false)));
+
+  const manga::PathToFile first(fs::FilePath("/path/to/dir_11/archive1.testarch", true),
+                                fs::FilePath("/arc/path 1/file2.testimg", true));
+  const manga::PathToFile file(fs::FilePath("/path/to/dir_2/file1.testimg", true));
+  const size_t opened = archiver_.openCount();
+
+  for (int i = 0; i < 3; ++i) {
+    BOOST_REQUIRE(explorer.enter(first));
+    BOOST_CHECK_EQUAL(tools::byteArray2string(explorer.readCurrentFile()),
+                      tools::byteArray2string(CreateTestImage("Image File 5")));
+
+    BOOST_REQUIRE(explorer.enter(file));
+  }
+
+  BOOST_CHECK_EQUAL(archiver_.openCount() - opened, 3);
+}
+
 BOOST_FIXTURE_TEST_CASE(ExplorerIterateNext_File, ExplorerTestFixture) {
   Construct(true, true);
 
@@ -430,6 +646,232 @@ BOOST_FIXTURE_TEST_CASE(ExplorerIteratePrevious_File, ExplorerTestFixture) {
   DoPreviousIterationTest(explorer);
 }
 
+BOOST_FIXTURE_TEST_CASE(ExplorerIterateNext_File_LazyScan, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setLazyScan(true);
+
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(explorer);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerIteratePrevious_File_LazyScan, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setLazyScan(true);
+
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  DoPreviousIterationTest(explorer);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerEnter_LazyScan, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setLazyScan(true);
+
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  // Directories on the way are not listed yet
+  for (size_t i = iter_files_.size(); i > 0; --i) {
+    BOOST_REQUIRE(explorer.enter(iter_files_[i - 1]));
+    BOOST_CHECK_EQUAL(iter_files_[i - 1], explorer.getCurrentPos());
+  }
+
+  BOOST_REQUIRE(explorer.enter(iter_files_[5]));
+  BOOST_REQUIRE(explorer.toNextFile());
+  BOOST_CHECK_EQUAL(iter_files_[6], explorer.getCurrentPos());
+}
+
+// Counts listings of wrapped file system which is not owned
+class CountingFileSystem: public fs::IFileManager {
+public:
+  explicit CountingFileSystem(fs::IFileManager* file_mgr)
+    : file_mgr_(file_mgr), listings(0) {}
+
+  virtual std::vector<fs::FilePath> getFileList(const fs::FilePath& root, EntryTypes entries, bool recursive) {
+    ++listings;
+    return file_mgr_->getFileList(root, entries, recursive);
+  }
+
+  virtual tools::ByteArray readFile(const fs::FilePath& file, size_t max_size) {
+    return file_mgr_->readFile(file, max_size);
+  }
+
+  virtual bool getModificationTime(const fs::FilePath& file, time_t& time) {
+    return file_mgr_->getModificationTime(file, time);
+  }
+
+  fs::IFileManager* file_mgr_;
+  size_t listings;
+};
+
+BOOST_FIXTURE_TEST_CASE(ExplorerIterate_Catalog, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Catalog catalog;
+  {
+    CountingFileSystem* file_mgr = new CountingFileSystem(file_system_.get());
+    manga::BookExplorer explorer(file_mgr, fs::IFileManager::File);
+    explorer.setCatalog(&catalog);
+    explorer.setRoot(fs::FilePath("/path/to/", false));
+
+    DoNextIterationTest(explorer);
+    BOOST_CHECK_GT(file_mgr->listings, 0U);
+  }
+
+  BOOST_CHECK_GT(catalog.size(), 0U);
+
+  CountingFileSystem* file_mgr = new CountingFileSystem(file_system_.get());
+  manga::BookExplorer explorer(file_mgr, fs::IFileManager::File);
+  explorer.setCatalog(&catalog);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(explorer);
+  DoPreviousIterationTest(explorer);
+  BOOST_CHECK_EQUAL(file_mgr->listings, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerIterate_Catalog_LazyScan, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Catalog catalog;
+  {
+    manga::BookExplorer explorer(new CountingFileSystem(file_system_.get()), fs::IFileManager::File);
+    explorer.setCatalog(&catalog);
+    explorer.setLazyScan(true);
+    explorer.setRoot(fs::FilePath("/path/to/", false));
+
+    DoPreviousIterationTest(explorer);
+  }
+
+  CountingFileSystem* file_mgr = new CountingFileSystem(file_system_.get());
+  manga::BookExplorer explorer(file_mgr, fs::IFileManager::File);
+  explorer.setCatalog(&catalog);
+  explorer.setLazyScan(true);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(explorer);
+  BOOST_CHECK_EQUAL(file_mgr->listings, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerApplyChanges_Created, ExplorerTestFixture) {
+  Construct(true, true);
+
+  TestFileSystem* file_system = file_system_.get();
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+  BOOST_REQUIRE(explorer.enter(iter_files_[2]));
+
+  file_system->addFile("/path/to/dir_5/file2a.testimg", CreateTestImage("New Image 1"));
+  file_system->addFile("/path/to/dir_7/file.testimg", CreateTestImage("New Image 2"));
+
+  std::vector<fs::FileChange> changes;
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_5/file2a.testimg", true)));
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_7", false)));
+  // Listed with its directory
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_7/file.testimg", true)));
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_2/file1.testimg", true)));
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/other/file.testimg", true)));
+  BOOST_CHECK(explorer.applyChanges(changes));
+  BOOST_CHECK_EQUAL(iter_files_[2], explorer.getCurrentPos());
+
+  iter_files_.insert(iter_files_.begin() + 2, manga::PathToFile(fs::FilePath("/path/to/dir_5/file2a.testimg", true)));
+  iter_files_.insert(iter_files_.begin() + 3, manga::PathToFile(fs::FilePath("/path/to/dir_7/file.testimg", true)));
+  DoNextIterationTest(explorer);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerApplyChanges_Deleted, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+  BOOST_REQUIRE(explorer.enter(iter_files_[2]));
+
+  std::vector<fs::FileChange> changes;
+  changes.push_back(fs::FileChange(fs::FileChange::Deleted, fs::FilePath("/path/to/dir_10/file3.testimg", true)));
+  changes.push_back(fs::FileChange(fs::FileChange::Deleted, fs::FilePath("/path/to/dir_100", false)));
+  BOOST_CHECK(explorer.applyChanges(changes));
+  BOOST_CHECK(!explorer.applyChanges(changes));
+
+  // Position goes to the next entry
+  BOOST_CHECK_EQUAL(iter_files_[3].filePath, explorer.getCurrentPos().filePath);
+
+  std::vector<manga::PathToFile> left;
+  for (size_t i = 0; i < iter_files_.size(); ++i) {
+    if (i != 2 && !iter_files_[i].filePath.startsWith(fs::FilePath("/path/to/dir_100", false)))
+      left.push_back(iter_files_[i]);
+  }
+
+  iter_files_.swap(left);
+  DoNextIterationTest(explorer);
+  DoPreviousIterationTest(explorer);
+}
+
+BOOST_FIXTURE_TEST_CASE(ExplorerApplyChanges_LazyScan, ExplorerTestFixture) {
+  Construct(true, true);
+
+  TestFileSystem* file_system = file_system_.get();
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setLazyScan(true);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  file_system->addFile("/path/to/dir_7/file.testimg", CreateTestImage("New Image 1"));
+  file_system->addFile("/path/to/dir_100/subdir 02/file2a.testimg", CreateTestImage("New Image 2"));
+
+  std::vector<fs::FileChange> changes;
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_7", false)));
+  // Directory is not listed yet, file is found when it's listed
+  changes.push_back(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_100/subdir 02/file2a.testimg", true)));
+  changes.push_back(fs::FileChange(fs::FileChange::Deleted, fs::FilePath("/path/to/dir_10", false)));
+  BOOST_CHECK(explorer.applyChanges(changes));
+
+  iter_files_.erase(iter_files_.begin() + 2);
+  iter_files_.insert(iter_files_.begin() + 2, manga::PathToFile(fs::FilePath("/path/to/dir_7/file.testimg", true)));
+  for (size_t i = 0; i < iter_files_.size(); ++i) {
+    if (iter_files_[i].filePath == fs::FilePath("/path/to/dir_100/subdir 02/file2.testimg", true)) {
+      iter_files_.insert(iter_files_.begin() + i + 1,
+                         manga::PathToFile(fs::FilePath("/path/to/dir_100/subdir 02/file2a.testimg", true)));
+      break;
+    }
+  }
+
+  DoNextIterationTest(explorer);
+}
+
+// Directories are watched when they are listed, not when watching starts
+BOOST_FIXTURE_TEST_CASE(ExplorerWatch_LazyScan, ExplorerTestFixture) {
+  Construct(false, true);
+
+  TestFileSystem* file_system = file_system_.get();
+  file_system->setUnwatchable(fs::FilePath("/path/to/dir_5", false));
+  manga::BookExplorer explorer(releaseFileSystem(), fs::IFileManager::File);
+  explorer.setLazyScan(true);
+  explorer.setWatching(true);
+  explorer.setRoot(fs::FilePath("/path/to/", false));
+
+  const std::vector<fs::FilePath>& watched = file_system->watchedDirs();
+  BOOST_REQUIRE_EQUAL(watched.size(), 1U);
+  BOOST_CHECK_EQUAL(watched[0], fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(explorer.toFirstFile());
+  BOOST_CHECK(std::find(watched.begin(), watched.end(), fs::FilePath("/path/to/dir_2", false)) != watched.end());
+  BOOST_CHECK(std::find(watched.begin(), watched.end(), fs::FilePath("/path/to/dir_10", false)) == watched.end());
+  bool changed = true;
+  BOOST_CHECK(explorer.update(changed));
+  BOOST_CHECK(!changed);
+
+  // Changes of directory which can't be watched are lost
+  BOOST_REQUIRE(explorer.toNextFile());
+  BOOST_CHECK_EQUAL(explorer.getCurrentPos(), manga::PathToFile(fs::FilePath("/path/to/dir_5/file2.testimg", true)));
+  BOOST_CHECK(!explorer.update(changed));
+  BOOST_CHECK(explorer.update(changed));
+}
+
 BOOST_FIXTURE_TEST_CASE(ExplorerIterateNothing_FileAndDir, ExplorerTestFixture) {
   Construct(false, false);
 
@@ -572,6 +1014,266 @@ BOOST_FIXTURE_TEST_CASE(BookIterate_Next_Preload_Files, ExplorerTestFixture) {
   DoNextIterationTest(book, true);
 }
 
+BOOST_FIXTURE_TEST_CASE(BookIterate_Next_Async_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Book book(releaseFileSystem());
+  book.setAsyncLoading(true);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(book, true);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Previous_Async_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Book book(releaseFileSystem());
+  book.setAsyncLoading(true);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoPreviousIterationTest(book, true);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Next_Window_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Book book(releaseFileSystem());
+  book.setWindow(4, 2);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(book, true);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Previous_Window_Async_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::PageCache page_cache(1024 * 1024);
+  manga::Book book(releaseFileSystem());
+  book.setPageCache(&page_cache);
+  book.setAsyncLoading(true);
+  book.setWindow(3, 2);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoPreviousIterationTest(book, true);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Next_Window_MemoryLimit_Async_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  {
+    manga::Book book(new CountingFileSystem(file_system_.get()));
+    book.setAsyncLoading(true);
+    book.setWindow(5, 5, 1);
+    book.setRoot(fs::FilePath("/path/to/", false));
+
+    DoNextIterationTest(book, true);
+  }
+
+  // Every load looks into page cache first, so its misses count loads
+  const size_t limits[] = { 1, 40, 0 };
+  const size_t loaded[] = { 1, 2, 5 };
+  for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); ++i) {
+    manga::PageCache page_cache(1024 * 1024);
+    manga::Book book(new CountingFileSystem(file_system_.get()));
+    book.setPageCache(&page_cache);
+    book.setWindow(5, 5, limits[i]);
+    book.setRoot(fs::FilePath("/path/to/", false));
+    BOOST_REQUIRE(book.toFirstFile());
+
+    page_cache.resetStatistics();
+    book.preload();
+    BOOST_CHECK_EQUAL(page_cache.statistics().misses, loaded[i]);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Previous_PageCache_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::PageCache page_cache(1024 * 1024);
+  manga::Book book(releaseFileSystem());
+  book.setPageCache(&page_cache);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(book.toFirstFile());
+  while (book.incrementPosition()) {}
+
+  const manga::PageCache::Statistics forward = page_cache.statistics();
+  BOOST_CHECK_EQUAL(forward.hits, 0U);
+
+  size_t i = iter_images_.size();
+  do {
+    BOOST_REQUIRE_GT(i, 0U);
+    BOOST_CHECK_EQUAL(iter_images_[--i], DataFromTestImage(book.currentImage()));
+  } while (book.decrementPosition());
+
+  // Going back nothing is decoded again
+  const manga::PageCache::Statistics backward = page_cache.statistics();
+  BOOST_CHECK_EQUAL(backward.misses, forward.misses);
+  BOOST_CHECK_EQUAL(backward.hits, iter_images_.size() - 2);
+  BOOST_CHECK_EQUAL(backward.evictions, 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookGoToBookmark_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Book book(releaseFileSystem());
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(book.toFirstFile());
+  for (size_t i = 0; i < 5; ++i)
+    BOOST_REQUIRE(book.incrementPosition());
+
+  const manga::Bookmark bookmark = book.bookmark();
+  BOOST_CHECK_EQUAL(bookmark.rootDir, fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(book.toFirstFile());
+  BOOST_REQUIRE(book.goToBookmark(bookmark));
+  BOOST_CHECK_EQUAL(iter_images_[5], DataFromTestImage(book.currentImage()));
+
+  BOOST_REQUIRE(book.incrementPosition());
+  BOOST_CHECK_EQUAL(iter_images_[6], DataFromTestImage(book.currentImage()));
+
+  BOOST_REQUIRE(book.decrementPosition());
+  BOOST_REQUIRE(book.decrementPosition());
+  BOOST_CHECK_EQUAL(iter_images_[4], DataFromTestImage(book.currentImage()));
+}
+
+// File added after the tree was scanned is found by rescanning it
+BOOST_FIXTURE_TEST_CASE(BookGoToBookmark_AddedFile, ExplorerTestFixture) {
+  Construct(false, true);
+
+  TestFileSystem* file_system = file_system_.get();
+  manga::Book book(releaseFileSystem());
+  book.setRoot(fs::FilePath("/path/to/", false));
+  BOOST_REQUIRE(book.toFirstFile());
+
+  file_system->addFile("/path/to/dir_7/file.testimg", CreateTestImage("New Image"));
+  manga::Bookmark bookmark = book.bookmark();
+  bookmark.currentFile = manga::PathToFile(fs::FilePath("/path/to/dir_7/file.testimg", true));
+
+  BOOST_REQUIRE(book.goToBookmark(bookmark));
+  BOOST_CHECK_EQUAL("New Image", DataFromTestImage(book.currentImage()));
+  BOOST_REQUIRE(book.decrementPosition());
+  BOOST_CHECK_EQUAL("Image File 2", DataFromTestImage(book.currentImage()));
+
+  bookmark.currentFile = manga::PathToFile(fs::FilePath("/path/to/dir_7/missing.testimg", true));
+  BOOST_CHECK(!book.goToBookmark(bookmark));
+}
+
+BOOST_AUTO_TEST_CASE(ExplorerEnter_LargeLibrary) {
+  std::auto_ptr<TestFileSystem> tfs(new TestFileSystem);
+  std::vector<manga::PathToFile> files;
+  for (int dir = 0; dir < 200; ++dir) {
+    for (int file = 0; file < 100; ++file) {
+      std::ostringstream path;
+      path << "/library/volume " << dir << "/page " << file << ".jpg";
+      tfs->addFile(path.str());
+      files.push_back(manga::PathToFile(fs::FilePath(path.str(), true)));
+    }
+  }
+
+  manga::BookExplorer explorer(tfs.release(), fs::IFileManager::File);
+  BOOST_REQUIRE(explorer.setRoot(fs::FilePath("/library/", false)));
+
+  BENCHMARK("BookExplorer::enter, 20000 files") {
+    for (size_t i = 0; i < files.size(); i += 20) {
+      BOOST_REQUIRE(explorer.enter(files[i]));
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); i += 997) {
+    BOOST_REQUIRE(explorer.enter(files[i]));
+    BOOST_CHECK_EQUAL(explorer.getCurrentPos(), files[i]);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Previous_LazyScan_Async_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Book book(releaseFileSystem());
+  book.setLazyScan(true);
+  book.setAsyncLoading(true);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoPreviousIterationTest(book, true);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookIterate_Next_Catalog_ArchivesFiles, ExplorerTestFixture) {
+  Construct(true, true);
+
+  manga::Catalog catalog;
+  {
+    manga::Book book(new CountingFileSystem(file_system_.get()));
+    book.setCatalog(&catalog);
+    book.setRoot(fs::FilePath("/path/to/", false));
+
+    DoNextIterationTest(book, true);
+  }
+
+  // Archives are listed from catalog and opened to read pages
+  manga::Book book(new CountingFileSystem(file_system_.get()));
+  book.setCatalog(&catalog);
+  book.setRoot(fs::FilePath("/path/to/", false));
+
+  DoNextIterationTest(book, true);
+}
+
+// Books which decode in different ways don't take pages of each other
+BOOST_FIXTURE_TEST_CASE(BookRead_DecodeOptions_PageCache, ExplorerTestFixture) {
+  Construct(false, true);
+
+  manga::PageCache page_cache(1024 * 1024);
+  manga::Book full(new CountingFileSystem(file_system_.get()));
+  full.setPageCache(&page_cache);
+  full.setRoot(fs::FilePath("/path/to/", false));
+
+  manga::Book cropped(new CountingFileSystem(file_system_.get()));
+  img::DecodeOptions options;
+  options.region = utils::Rect(6, 0, 4, 1);
+  cropped.setDecodeOptions(options);
+  cropped.setPageCache(&page_cache);
+  cropped.setRoot(fs::FilePath("/path/to/", false));
+
+  BOOST_REQUIRE(full.toFirstFile());
+  BOOST_CHECK_EQUAL("Image File 1", DataFromTestImage(full.currentImage()));
+  BOOST_REQUIRE(cropped.toFirstFile());
+  BOOST_CHECK_EQUAL("File", DataFromTestImage(cropped.currentImage()));
+
+  // Both versions are cached
+  BOOST_REQUIRE(full.toFirstFile());
+  BOOST_CHECK_EQUAL("Image File 1", DataFromTestImage(full.currentImage()));
+  BOOST_REQUIRE(cropped.toFirstFile());
+  BOOST_CHECK_EQUAL("File", DataFromTestImage(cropped.currentImage()));
+  BOOST_CHECK_EQUAL(page_cache.statistics().hits, 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookUpdate_Watching, ExplorerTestFixture) {
+  Construct(false, true);
+
+  TestFileSystem* file_system = file_system_.get();
+  manga::Book book(releaseFileSystem());
+  book.setWatching(true);
+  book.setRoot(fs::FilePath("/path/to/", false));
+  BOOST_REQUIRE(book.toFirstFile());
+  book.preload();
+
+  file_system->addFile("/path/to/dir_2/file2.testimg", CreateTestImage("New Image"));
+  file_system->addChange(fs::FileChange(fs::FileChange::Created, fs::FilePath("/path/to/dir_2/file2.testimg", true)));
+  BOOST_CHECK(book.update());
+  BOOST_CHECK_EQUAL("Image File 1", DataFromTestImage(book.currentImage()));
+
+  BOOST_REQUIRE(book.incrementPosition());
+  BOOST_CHECK_EQUAL("New Image", DataFromTestImage(book.currentImage()));
+  book.preload();
+
+  // Next file becomes current
+  file_system->addChange(fs::FileChange(fs::FileChange::Deleted, fs::FilePath("/path/to/dir_2/file2.testimg", true)));
+  BOOST_CHECK(book.update());
+  BOOST_CHECK_EQUAL("Image File 2", DataFromTestImage(book.currentImage()));
+
+  BOOST_REQUIRE(book.decrementPosition());
+  BOOST_CHECK_EQUAL("Image File 1", DataFromTestImage(book.currentImage()));
+}
 
 BOOST_AUTO_TEST_SUITE_END()
 }
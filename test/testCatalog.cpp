@@ -0,0 +1,151 @@
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "catalog.h"
+
+namespace test {
+// --log_level=test_suite --run_test=TestCatalog
+BOOST_AUTO_TEST_SUITE(TestCatalog)
+
+class CatalogFixture {
+public:
+  CatalogFixture() {
+    char name[] = "/tmp/pocketmanga_catalog_XXXXXX";
+    const int fd = mkstemp(name);
+    BOOST_REQUIRE_NE(fd, -1);
+    close(fd);
+    file_ = fs::FilePath(name, true);
+  }
+
+  ~CatalogFixture() {
+    remove(file_.getPath().c_str());
+  }
+
+  static manga::Catalog::FileList DirEntries() {
+    manga::Catalog::FileList entries;
+    entries.push_back(fs::FilePath("/library/book 1", false));
+    entries.push_back(fs::FilePath("/library/book 2.zip", true));
+    entries.push_back(fs::FilePath("/library/cover.jpg", true));
+    return entries;
+  }
+
+  static manga::Catalog::FileList ArchiveEntries() {
+    manga::Catalog::FileList entries;
+    entries.push_back(fs::FilePath("chapter 1/page1.jpg", true));
+    entries.push_back(fs::FilePath("chapter 1/page2.jpg", true));
+    return entries;
+  }
+
+  static void CheckEqual(const manga::Catalog::FileList& left, const manga::Catalog::FileList& right) {
+    BOOST_REQUIRE_EQUAL(left.size(), right.size());
+    for (size_t i = 0; i < left.size(); ++i) {
+      BOOST_CHECK_EQUAL(left[i], right[i]);
+      BOOST_CHECK_EQUAL(left[i].isDirectory(), right[i].isDirectory());
+    }
+  }
+
+protected:
+  fs::FilePath file_;
+};
+
+BOOST_FIXTURE_TEST_CASE(Catalog_FindDirectory, CatalogFixture) {
+  manga::Catalog catalog;
+  const fs::FilePath dir("/library", false);
+  manga::Catalog::FileList entries;
+
+  BOOST_CHECK(!catalog.findDirectory(dir, 10, entries));
+
+  catalog.setDirectory(dir, 10, DirEntries());
+  BOOST_REQUIRE(catalog.findDirectory(dir, 10, entries));
+  CheckEqual(DirEntries(), entries);
+
+  // Changed directory
+  BOOST_CHECK(!catalog.findDirectory(dir, 11, entries));
+  // Archive with the same path is a different listing
+  bool is_archive = false;
+  BOOST_CHECK(!catalog.findArchive(fs::FilePath("/library", true), 10, false, is_archive, entries));
+}
+
+BOOST_FIXTURE_TEST_CASE(Catalog_FindArchive, CatalogFixture) {
+  manga::Catalog catalog;
+  const fs::FilePath archive("/library/book 2.zip", true);
+  const fs::FilePath image("/library/cover.jpg", true);
+
+  catalog.setArchive(archive, 20, true, true, ArchiveEntries());
+  catalog.setArchive(image, 30, true, false, manga::Catalog::FileList());
+
+  bool is_archive = false;
+  manga::Catalog::FileList entries;
+  BOOST_REQUIRE(catalog.findArchive(archive, 20, true, is_archive, entries));
+  BOOST_CHECK(is_archive);
+  CheckEqual(ArchiveEntries(), entries);
+
+  BOOST_CHECK(!catalog.findArchive(archive, 20, false, is_archive, entries));
+
+  BOOST_REQUIRE(catalog.findArchive(image, 30, true, is_archive, entries));
+  BOOST_CHECK(!is_archive);
+  BOOST_CHECK(entries.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(Catalog_SaveLoad, CatalogFixture) {
+  const fs::FilePath dir("/library", false);
+  const fs::FilePath archive("/library/book 2.zip", true);
+  {
+    manga::Catalog catalog;
+    catalog.setDirectory(dir, 10, DirEntries());
+    catalog.setArchive(archive, 20, true, true, ArchiveEntries());
+    BOOST_REQUIRE(catalog.save(file_));
+  }
+
+  manga::Catalog catalog;
+  BOOST_REQUIRE(catalog.load(file_));
+  BOOST_CHECK_EQUAL(catalog.size(), 2U);
+
+  manga::Catalog::FileList entries;
+  BOOST_REQUIRE(catalog.findDirectory(dir, 10, entries));
+  CheckEqual(DirEntries(), entries);
+
+  bool is_archive = false;
+  BOOST_REQUIRE(catalog.findArchive(archive, 20, true, is_archive, entries));
+  BOOST_CHECK(is_archive);
+  CheckEqual(ArchiveEntries(), entries);
+
+  // Loaded listings are kept on save over the mapped file
+  catalog.setDirectory(fs::FilePath("/library/book 1", false), 40, manga::Catalog::FileList());
+  BOOST_REQUIRE(catalog.save(file_));
+
+  manga::Catalog reloaded;
+  BOOST_REQUIRE(reloaded.load(file_));
+  BOOST_CHECK_EQUAL(reloaded.size(), 3U);
+  BOOST_REQUIRE(reloaded.findDirectory(dir, 10, entries));
+  CheckEqual(DirEntries(), entries);
+}
+
+BOOST_FIXTURE_TEST_CASE(Catalog_LoadBroken, CatalogFixture) {
+  manga::Catalog catalog;
+  catalog.setDirectory(fs::FilePath("/library", false), 10, DirEntries());
+  BOOST_REQUIRE(catalog.save(file_));
+
+  // Cut in the middle of the last record
+  std::ifstream in(file_.getPath().c_str(), std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream out(file_.getPath().c_str(), std::ios::binary | std::ios::trunc);
+  out.write(data.data(), data.size() - 5);
+  out.close();
+
+  manga::Catalog loaded;
+  loaded.setDirectory(fs::FilePath("/other", false), 10, DirEntries());
+  BOOST_CHECK(!loaded.load(file_));
+  BOOST_CHECK_EQUAL(loaded.size(), 1U);
+
+  BOOST_CHECK(!loaded.load(fs::FilePath("/path/which/does/not/exist", true)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
@@ -0,0 +1,211 @@
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cacheScaler.h"
+#include "diskCache.h"
+#include "filemanager.h"
+#include "image.h"
+
+#include "testFileSystem.h"
+#include "testImageDecoder.h"
+
+namespace test {
+// --log_level=test_suite --run_test=TestDiskCache
+BOOST_AUTO_TEST_SUITE(TestDiskCache)
+
+// Large enough for all pages of a test
+const unsigned long long CacheSize = 64 * 1024 * 1024;
+
+class DiskCacheFixture {
+public:
+  DiskCacheFixture() {
+    char name[] = "/tmp/pocketmanga_cache_XXXXXX";
+    BOOST_REQUIRE(mkdtemp(name));
+    directory_ = fs::FilePath(name, false);
+  }
+
+  ~DiskCacheFixture() {
+    std::auto_ptr<fs::IFileManager> file_mgr(fs::IFileManager::create());
+    const std::vector<fs::FilePath> files =
+      file_mgr->getFileList(directory_, fs::IFileManager::File, false);
+
+    for (size_t i = 0; i < files.size(); ++i)
+      remove(files[i].getPath().c_str());
+
+    rmdir(directory_.getPath().c_str());
+  }
+
+  size_t filesCount() const {
+    std::auto_ptr<fs::IFileManager> file_mgr(fs::IFileManager::create());
+    return file_mgr->getFileList(directory_, fs::IFileManager::File, false).size();
+  }
+
+  static img::Image PageImage() {
+    img::Image image(300, 400, 3);
+    unsigned char* data = image.data();
+    for (size_t i = 0; i < img::dataSize(image); ++i)
+      data[i] = static_cast<unsigned char>(i * 7);
+
+    return image;
+  }
+
+  static manga::PathToFile PagePath(int page = 1) {
+    std::ostringstream name;
+    name << "page" << page << ".jpg";
+    return manga::PathToFile(fs::FilePath("/path/to/archive.zip", true), fs::FilePath(name.str(), true));
+  }
+
+protected:
+  fs::FilePath directory_;
+};
+
+BOOST_FIXTURE_TEST_CASE(RestoreScaled, DiskCacheFixture) {
+  manga::DiskCache cache(directory_, CacheSize);
+
+  manga::CacheScaler scaler(100, 200);
+  img::Image image = PageImage();
+  static_cast<manga::IBookCache&>(scaler).onLoaded(image);
+  BOOST_REQUIRE(cache.insert(PagePath(), 10, "", scaler));
+  BOOST_CHECK_EQUAL(filesCount(), 1U);
+
+  manga::CacheScaler restored(100, 200);
+  BOOST_REQUIRE(cache.find(PagePath(), 10, "", restored));
+
+  const manga::CacheScaler::Cache& expected = scaler.scaledGrey();
+  const manga::CacheScaler::Cache& actual = restored.scaledGrey();
+  BOOST_CHECK_EQUAL(expected.orientation, actual.orientation);
+  BOOST_CHECK_EQUAL(expected.representation, actual.representation);
+  BOOST_CHECK_EQUAL(expected.bounds.x, actual.bounds.x);
+  BOOST_CHECK_EQUAL(expected.bounds.width, actual.bounds.width);
+  BOOST_CHECK_EQUAL(expected.bounds.height, actual.bounds.height);
+  BOOST_REQUIRE_EQUAL(expected.image.width(), actual.image.width());
+  BOOST_REQUIRE_EQUAL(expected.image.height(), actual.image.height());
+  BOOST_REQUIRE_EQUAL(expected.image.depth(), actual.image.depth());
+  BOOST_CHECK(0 == memcmp(expected.image.data(), actual.image.data(), img::dataSize(expected.image)));
+}
+
+BOOST_FIXTURE_TEST_CASE(StaleResults, DiskCacheFixture) {
+  manga::DiskCache cache(directory_, CacheSize);
+
+  manga::CacheScaler scaler(100, 200);
+  img::Image image = PageImage();
+  static_cast<manga::IBookCache&>(scaler).onLoaded(image);
+  BOOST_REQUIRE(cache.insert(PagePath(), 10, "", scaler));
+
+  // File was modified
+  manga::CacheScaler restored(100, 200);
+  BOOST_CHECK(!cache.find(PagePath(), 11, "", restored));
+
+  // Other page
+  BOOST_CHECK(!cache.find(manga::PathToFile(fs::FilePath("/path/to/archive.zip", true), fs::FilePath("page2.jpg", true)), 10, "", restored));
+
+  // Other decoding
+  BOOST_CHECK(!cache.find(PagePath(), 10, "other", restored));
+
+  // Other screen
+  manga::CacheScaler other_screen(200, 100);
+  BOOST_CHECK(!cache.find(PagePath(), 10, "", other_screen));
+}
+
+BOOST_FIXTURE_TEST_CASE(NotPersistent, DiskCacheFixture) {
+  manga::DiskCache cache(directory_, CacheSize);
+
+  // Nothing to store before onLoaded
+  manga::CacheScaler scaler(100, 200);
+  BOOST_CHECK(!cache.insert(PagePath(), 10, "", scaler));
+  BOOST_CHECK_EQUAL(filesCount(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(BookRestoresPages, DiskCacheFixture) {
+  TestImageDecoder decoder;
+  manga::DiskCache cache(directory_, CacheSize);
+
+  std::vector<std::string> pages;
+  pages.push_back("/book/page1.testimg");
+  pages.push_back("/book/page2.testimg");
+  pages.push_back("/book/page3.testimg");
+
+  std::vector<img::Image::SizeType> widths;
+  for (int pass = 0; pass < 2; ++pass) {
+    std::auto_ptr<TestFileSystem> file_system(new TestFileSystem);
+    for (size_t i = 0; i < pages.size(); ++i)
+      file_system->addFile(pages[i], CreateTestImage(std::string(i + 10, 'a')));
+
+    manga::Book book(file_system.release());
+    book.setCachePrototype(new manga::CacheScaler(100, 200));
+    book.setDiskCache(&cache);
+    book.setRoot(fs::FilePath("/book/", false));
+
+    BOOST_REQUIRE(book.toFirstFile());
+    size_t i = 0;
+    do {
+      manga::CacheScaler* scaler = static_cast<manga::CacheScaler*>(book.currentCache());
+      const img::Image::SizeType width = scaler->scaledGrey().image.width();
+      BOOST_REQUIRE_LT(i, pages.size());
+      if (0 == pass) {
+        widths.push_back(width);
+      } else {
+        // Restored without decoding
+        BOOST_CHECK(book.currentImage().empty());
+        BOOST_CHECK_EQUAL(widths[i], width);
+      }
+      ++i;
+    } while (book.incrementPosition());
+
+    BOOST_CHECK_EQUAL(i, pages.size());
+    BOOST_CHECK_EQUAL(filesCount(), pages.size());
+  }
+}
+
+// Least recently used pages are removed when files exceed the limit
+BOOST_FIXTURE_TEST_CASE(SizeLimit, DiskCacheFixture) {
+  manga::CacheScaler scaler(100, 200);
+  img::Image image = PageImage();
+  static_cast<manga::IBookCache&>(scaler).onLoaded(image);
+
+  unsigned long long file_size = 0;
+  {
+    manga::DiskCache cache(directory_, CacheSize);
+    BOOST_REQUIRE(cache.insert(PagePath(1), 10, "", scaler));
+    file_size = cache.size();
+    BOOST_REQUIRE_GT(file_size, 0U);
+  }
+
+  // File of previous run is counted
+  manga::DiskCache cache(directory_, 3 * file_size);
+  BOOST_CHECK_EQUAL(cache.size(), file_size);
+
+  BOOST_REQUIRE(cache.insert(PagePath(2), 10, "", scaler));
+  BOOST_REQUIRE(cache.insert(PagePath(3), 10, "", scaler));
+  manga::CacheScaler restored(100, 200);
+  BOOST_REQUIRE(cache.find(PagePath(1), 10, "", restored));
+
+  BOOST_REQUIRE(cache.insert(PagePath(4), 10, "", scaler));
+  BOOST_CHECK_EQUAL(cache.size(), 3 * file_size);
+  BOOST_CHECK_EQUAL(filesCount(), 3U);
+  BOOST_CHECK(cache.find(PagePath(1), 10, "", restored));
+  BOOST_CHECK(!cache.find(PagePath(2), 10, "", restored));
+  BOOST_CHECK(cache.find(PagePath(3), 10, "", restored));
+  BOOST_CHECK(cache.find(PagePath(4), 10, "", restored));
+
+  // Limit is applied to files of previous run
+  manga::DiskCache smaller(directory_, file_size);
+  BOOST_CHECK_EQUAL(smaller.size(), file_size);
+  BOOST_CHECK_EQUAL(filesCount(), 1U);
+
+  // Page larger than the whole cache isn't kept
+  manga::DiskCache tiny(directory_, file_size - 1);
+  BOOST_CHECK_EQUAL(filesCount(), 0U);
+  BOOST_CHECK(!tiny.insert(PagePath(5), 10, "", scaler));
+  BOOST_CHECK_EQUAL(tiny.size(), 0U);
+  BOOST_CHECK_EQUAL(filesCount(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
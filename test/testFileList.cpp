@@ -6,6 +6,15 @@
 #include "time.h"
 //#include "filepath.h"
 
+#include <memory>
+#include <set>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace {
 int inc(int& index) {
   return index++;
@@ -201,5 +210,157 @@ BOOST_AUTO_TEST_CASE(Sorting_JustNumbers) {
   BOOST_CHECK_EQUAL(paths[inc(i)].getPath(), "/aaa3a/aaaa03s.zip");
 }
 
+std::set<std::string> PathsOf(const std::vector<fs::FilePath>& paths) {
+  std::set<std::string> result;
+  for (size_t i = 0; i < paths.size(); ++i)
+    result.insert(paths[i].getPath() + (paths[i].isDirectory() ? "/" : ""));
+
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(FileManager_Recursive) {
+  char name[] = "/tmp/pocketmanga_list_XXXXXX";
+  BOOST_REQUIRE(mkdtemp(name));
+  const std::string root = name;
+
+  // Every directory keeps files and subdirectories
+  std::set<std::string> dirs;
+  std::set<std::string> files;
+  std::vector<std::string> created;
+  for (int i = 0; i < 6; ++i) {
+    std::ostringstream dir;
+    dir << root << "/dir " << i;
+    BOOST_REQUIRE_EQUAL(0, mkdir(dir.str().c_str(), 0700));
+    dirs.insert(dir.str() + "/");
+    created.push_back(dir.str());
+
+    for (int j = 0; j < 3; ++j) {
+      std::ostringstream subdir;
+      subdir << dir.str() << "/sub " << j;
+      BOOST_REQUIRE_EQUAL(0, mkdir(subdir.str().c_str(), 0700));
+      dirs.insert(subdir.str() + "/");
+      created.push_back(subdir.str());
+
+      std::ostringstream file;
+      file << subdir.str() << "/page " << j << ".jpg";
+      fclose(fopen(file.str().c_str(), "w"));
+      files.insert(file.str());
+      created.push_back(file.str());
+    }
+
+    std::ostringstream file;
+    file << dir.str() << "/cover.jpg";
+    fclose(fopen(file.str().c_str(), "w"));
+    files.insert(file.str());
+    created.push_back(file.str());
+  }
+
+  std::auto_ptr<fs::IFileManager> file_mgr(fs::IFileManager::create());
+  const fs::FilePath root_path(root + "/", false);
+
+  const std::vector<fs::FilePath> all = file_mgr->getFileList(root_path, fs::IFileManager::FileAndDirectory, true);
+  std::set<std::string> expected = dirs;
+  expected.insert(files.begin(), files.end());
+  BOOST_CHECK(PathsOf(all) == expected);
+  BOOST_CHECK_EQUAL(all.size(), expected.size());
+
+  BOOST_CHECK(PathsOf(file_mgr->getFileList(root_path, fs::IFileManager::File, true)) == files);
+  BOOST_CHECK(PathsOf(file_mgr->getFileList(root_path, fs::IFileManager::Directory, true)) == dirs);
+  BOOST_CHECK_EQUAL(file_mgr->getFileList(root_path, fs::IFileManager::FileAndDirectory, false).size(), 6U);
+
+  // Order doesn't depend on threads
+  for (int i = 0; i < 5; ++i) {
+    const std::vector<fs::FilePath> again = file_mgr->getFileList(root_path, fs::IFileManager::FileAndDirectory, true);
+    BOOST_REQUIRE_EQUAL(again.size(), all.size());
+    for (size_t j = 0; j < all.size(); ++j)
+      BOOST_CHECK_EQUAL(again[j].getPath(), all[j].getPath());
+  }
+
+  for (size_t i = created.size(); i > 0; --i)
+    remove(created[i - 1].c_str());
+
+  rmdir(name);
+}
+
+std::vector<std::string> DescribeChanges(fs::IFileWatcher& watcher) {
+  std::vector<fs::FileChange> changes;
+  BOOST_CHECK(watcher.poll(changes));
+
+  std::vector<std::string> result;
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const fs::FilePath& path = changes[i].path;
+    result.push_back((fs::FileChange::Created == changes[i].type ? "+" : "-") +
+                     path.getName() + (path.isDirectory() ? "/" : ""));
+  }
+
+  return result;
+}
+
+#ifdef __linux__
+BOOST_AUTO_TEST_CASE(FileWatcher_Changes) {
+  char name[] = "/tmp/pocketmanga_watch_XXXXXX";
+  BOOST_REQUIRE(mkdtemp(name));
+  const std::string root = name;
+
+  // Directory isn't watched until it's added
+  BOOST_REQUIRE_EQUAL(0, mkdir((root + "/old").c_str(), 0700));
+
+  std::auto_ptr<fs::IFileManager> file_mgr(fs::IFileManager::create());
+  std::auto_ptr<fs::IFileWatcher> watcher(file_mgr->createWatcher());
+  BOOST_REQUIRE(watcher.get());
+  BOOST_REQUIRE(watcher->watch(fs::FilePath(root + "/", false)));
+  BOOST_CHECK(DescribeChanges(*watcher).empty());
+
+  fclose(fopen((root + "/old/d.jpg").c_str(), "w"));
+  BOOST_CHECK(DescribeChanges(*watcher).empty());
+  BOOST_REQUIRE(watcher->addDirectory(fs::FilePath(root + "/old/", false)));
+  remove((root + "/old/d.jpg").c_str());
+  std::vector<std::string> changes = DescribeChanges(*watcher);
+  BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+  BOOST_CHECK_EQUAL(changes[0], "-d.jpg");
+  rmdir((root + "/old").c_str());
+  changes = DescribeChanges(*watcher);
+  BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+  BOOST_CHECK_EQUAL(changes[0], "-old/");
+
+  fclose(fopen((root + "/a.jpg").c_str(), "w"));
+  BOOST_REQUIRE_EQUAL(0, mkdir((root + "/sub").c_str(), 0700));
+
+  changes = DescribeChanges(*watcher);
+  BOOST_REQUIRE_EQUAL(changes.size(), 2U);
+  BOOST_CHECK_EQUAL(changes[0], "+a.jpg");
+  BOOST_CHECK_EQUAL(changes[1], "+sub/");
+
+  // New directory is watched when receiver lists it, move is deletion
+  // and creation
+  BOOST_REQUIRE(watcher->addDirectory(fs::FilePath(root + "/sub/", false)));
+  fclose(fopen((root + "/sub/b.jpg").c_str(), "w"));
+  BOOST_REQUIRE_EQUAL(0, rename((root + "/a.jpg").c_str(), (root + "/sub/c.jpg").c_str()));
+
+  changes = DescribeChanges(*watcher);
+  BOOST_REQUIRE_EQUAL(changes.size(), 3U);
+  BOOST_CHECK_EQUAL(changes[0], "+b.jpg");
+  BOOST_CHECK_EQUAL(changes[1], "-a.jpg");
+  BOOST_CHECK_EQUAL(changes[2], "+c.jpg");
+
+  remove((root + "/sub/b.jpg").c_str());
+  remove((root + "/sub/c.jpg").c_str());
+  rmdir((root + "/sub").c_str());
+
+  changes = DescribeChanges(*watcher);
+  BOOST_REQUIRE_EQUAL(changes.size(), 3U);
+  BOOST_CHECK_EQUAL(changes[2], "-sub/");
+
+  // Failed watch is reported as lost changes
+  fclose(fopen((root + "/e.jpg").c_str(), "w"));
+  BOOST_CHECK(!watcher->addDirectory(fs::FilePath(root + "/e.jpg", false)));
+  std::vector<fs::FileChange> lost;
+  BOOST_CHECK(!watcher->poll(lost));
+  remove((root + "/e.jpg").c_str());
+
+  rmdir(name);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
 }
@@ -70,6 +70,69 @@ tools::ByteArray TestFileSystem::readFile(const fs::FilePath& file, size_t max_s
   return tools::ByteArray::empty;
 }
 
+bool TestFileSystem::getModificationTime(const fs::FilePath& /*file*/, time_t& time) {
+  time = 0;
+  return true;
+}
+
+namespace {
+class TestWatcher: public fs::IFileWatcher {
+public:
+  TestWatcher(std::vector<fs::FileChange>& changes, std::vector<fs::FilePath>& watched,
+              const std::vector<fs::FilePath>& unwatchable)
+    : changes_(changes), watched_(watched), unwatchable_(unwatchable), lost_(false) {}
+
+  virtual bool watch(const fs::FilePath& root) {
+    changes_.clear();
+    watched_.clear();
+    lost_ = false;
+    return addDirectory(root);
+  }
+
+  virtual bool addDirectory(const fs::FilePath& dir) {
+    if (std::find(unwatchable_.begin(), unwatchable_.end(), dir) != unwatchable_.end()) {
+      lost_ = true;
+      return false;
+    }
+
+    if (std::find(watched_.begin(), watched_.end(), dir) == watched_.end())
+      watched_.push_back(dir);
+
+    return true;
+  }
+
+  virtual bool poll(std::vector<fs::FileChange>& changes) {
+    changes.insert(changes.end(), changes_.begin(), changes_.end());
+    changes_.clear();
+    const bool complete = !lost_;
+    lost_ = false;
+    return complete;
+  }
+
+private:
+  std::vector<fs::FileChange>& changes_;
+  std::vector<fs::FilePath>& watched_;
+  const std::vector<fs::FilePath>& unwatchable_;
+  bool lost_;
+};
+}
+
+fs::IFileWatcher* TestFileSystem::createWatcher() {
+  return new TestWatcher(changes_, watched_, unwatchable_);
+}
+
+void TestFileSystem::addChange(const fs::FileChange& change) {
+  changes_.push_back(change);
+}
+
+const std::vector<fs::FilePath>& TestFileSystem::watchedDirs() const {
+  return watched_;
+}
+
+void TestFileSystem::setUnwatchable(const fs::FilePath& dir) {
+  unwatchable_.push_back(dir);
+}
+
 struct CmpDir {
   const std::string& name_;
   CmpDir(const std::string& name)
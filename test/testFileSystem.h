@@ -10,6 +10,16 @@ class TestFileSystem: public fs::IFileManager {
 public:
   // fs::IFileManager
   virtual tools::ByteArray readFile(const fs::FilePath &file, size_t max_size);
+  // Files are never changed, time is always 0
+  virtual bool getModificationTime(const fs::FilePath &file, time_t &time);
+  // Watcher reports changes passed to addChange()
+  virtual fs::IFileWatcher *createWatcher();
+
+  void addChange(const fs::FileChange &change);
+  // Directories watched since last watch()
+  const std::vector<fs::FilePath> &watchedDirs() const;
+  // Watch of the directory fails as when system runs out of watches
+  void setUnwatchable(const fs::FilePath &dir);
 
   struct TestFile {
     std::string name;
@@ -41,6 +51,9 @@ private:
   //Dir *findDirByPath(const std::string &path) const;
 
   Dir root_;
+  std::vector<fs::FileChange> changes_;
+  std::vector<fs::FilePath> watched_;
+  std::vector<fs::FilePath> unwatchable_;
 
   Dir &findOrCreateDir(Dir &parent, const std::string &name);
 
@@ -16,12 +16,21 @@ const std::string& TestImgHeader() {
   return TestImageHeader;
 }
 
-TestImageDecoder::TestImageDecoder() {
+TestImageDecoder::TestImageDecoder()
+  : registered_(true) {
   img::DecoderFactory::getInstance().registerDecoder(this);
 }
 
+TestImageDecoder::TestImageDecoder(bool registered)
+  : registered_(registered) {}
+
 TestImageDecoder::~TestImageDecoder() {
-  img::DecoderFactory::getInstance().unregisterDecoder(getExts()[0]);
+  if (registered_)
+    img::DecoderFactory::getInstance().unregisterDecoder(getExts()[0]);
+}
+
+img::IDecoder* TestImageDecoder::clone() const {
+  return new TestImageDecoder(false);
 }
 
 std::vector<std::string> TestImageDecoder::getExts() const {
@@ -9,8 +9,15 @@ public:
   virtual ~TestImageDecoder();
 
   // img::IDecoder
+  virtual img::IDecoder* clone() const;
   virtual std::vector<std::string> getExts() const;
   virtual bool decode(const tools::ByteArray &encoded, img::Image &decoded);
+
+private:
+  // Clones are not registered
+  explicit TestImageDecoder(bool registered);
+
+  bool registered_;
 };
 
 tools::ByteArray CreateTestImage(const std::string &data);
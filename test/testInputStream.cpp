@@ -0,0 +1,173 @@
+#include <boost/test/unit_test.hpp>
+
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+
+#include "byteArray.h"
+#include "image.h"
+#include "inputStream.h"
+
+#include "testJpg_jpg.h"
+
+namespace {
+// Gives data by small chunks, the way archives give decompressed data
+class ChunkedStream : public tools::IInputStream {
+  tools::ByteArray data_;
+  size_t chunk_;
+  size_t pos_;
+public:
+  ChunkedStream(const tools::ByteArray& data, size_t chunk)
+    : data_(data), chunk_(chunk), pos_(0) {}
+
+  virtual bool next(const unsigned char*& data, size_t& size) {
+    if (pos_ >= data_.getSize())
+      return false;
+
+    data = data_.getData() + pos_;
+    size = std::min(chunk_, data_.getSize() - pos_);
+    pos_ += size;
+    return true;
+  }
+};
+
+tools::ByteArray ReadTestFile(const std::string& path) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return tools::toByteArray(data);
+}
+
+tools::ByteArray TestJpg() {
+  return tools::ByteArray(get_testJpg_jpg_buf(), get_testJpg_jpg_size());
+}
+
+bool IsSame(const img::Image& left, const img::Image& right) {
+  return left.width() == right.width() && left.height() == right.height() && left.depth() == right.depth() &&
+         img::dataSize(left) == img::dataSize(right) &&
+         0 == memcmp(left.data(), right.data(), img::dataSize(left));
+}
+
+void CheckChunks(const std::string& ext, const tools::ByteArray& data) {
+  img::Image expected;
+  BOOST_REQUIRE(expected.load(ext, data));
+
+  const size_t chunks[] = {1, 7, 4096, data.getSize()};
+  for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+    ChunkedStream stream(data, chunks[i]);
+    img::Image image;
+    BOOST_CHECK(image.load(ext, stream));
+    BOOST_CHECK_MESSAGE(IsSame(expected, image), ext << " by " << chunks[i] << " bytes");
+  }
+
+  // Truncated data fails and doesn't break the decoder
+  ChunkedStream truncated(data.copyPart(0, data.getSize() / 2), 100);
+  img::Image image;
+  BOOST_CHECK(!image.load(ext, truncated));
+  BOOST_CHECK(image.load(ext, data));
+  BOOST_CHECK(IsSame(expected, image));
+}
+}
+
+namespace test {
+// --log_level=test_suite --run_test=TestInputStream
+BOOST_AUTO_TEST_SUITE(TestInputStream)
+
+BOOST_AUTO_TEST_CASE(ReadAll) {
+  const tools::ByteArray data = tools::toByteArray("some data of stream");
+  ChunkedStream chunked(data, 3);
+  BOOST_CHECK(tools::compare(tools::readAll(chunked), data));
+  BOOST_CHECK(tools::readAll(chunked).isEmpty());
+
+  tools::MemoryInputStream memory(data.getData(), data.getSize());
+  const unsigned char* chunk = 0;
+  size_t size = 0;
+  BOOST_REQUIRE(memory.next(chunk, size));
+  BOOST_CHECK(chunk == data.getData());
+  BOOST_CHECK_EQUAL(size, data.getSize());
+  BOOST_CHECK(!memory.next(chunk, size));
+
+  tools::ByteArrayInputStream empty(tools::ByteArray::empty);
+  BOOST_CHECK(!empty.next(chunk, size));
+}
+
+BOOST_AUTO_TEST_CASE(Jpeg_Chunks) {
+  CheckChunks("jpg", TestJpg());
+}
+
+BOOST_AUTO_TEST_CASE(Png_Chunks) {
+  const tools::ByteArray data = ReadTestFile("test_data/pngs/hor_800x600.png");
+  BOOST_REQUIRE(!data.isEmpty());
+  CheckChunks("png", data);
+}
+
+// Without decoder for extension stream is read as a whole
+BOOST_AUTO_TEST_CASE(UnknownExtension) {
+  img::Image expected;
+  BOOST_REQUIRE(expected.load("jpg", TestJpg()));
+
+  ChunkedStream stream(TestJpg(), 100);
+  img::Image image;
+  BOOST_CHECK(image.load("unknown", stream));
+  BOOST_CHECK(IsSame(expected, image));
+
+  // Decoder of extension is the only one which reads the stream
+  ChunkedStream png_stream(TestJpg(), 100);
+  BOOST_CHECK(!image.load("png", png_stream));
+}
+
+// Size is read from the beginning of data
+BOOST_AUTO_TEST_CASE(ReadSize) {
+  const std::string exts[] = {"jpg", "png", "bmp"};
+  const tools::ByteArray files[] = {TestJpg(), ReadTestFile("test_data/pngs/hor_800x600.png"),
+                                  ReadTestFile("test_data/bmp/valid/8bpp-320x240.bmp")};
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+    BOOST_REQUIRE(!files[i].isEmpty());
+    img::Image expected;
+    BOOST_REQUIRE(expected.load(exts[i], files[i]));
+
+    utils::Size size;
+    BOOST_CHECK(img::Image::readSize(exts[i], files[i].copyPart(0, 2048), size));
+    BOOST_CHECK_EQUAL(size.width, expected.width());
+    BOOST_CHECK_EQUAL(size.height, expected.height());
+
+    // Other decoders are tried after the one of extension
+    size = utils::Size();
+    BOOST_CHECK(img::Image::readSize("unknown", files[i], size));
+    BOOST_CHECK_EQUAL(size.width, expected.width());
+
+    BOOST_CHECK(!img::Image::readSize(exts[i], files[i].copyPart(0, 16), size));
+
+    // Decoder works as usual after the probe
+    img::Image image;
+    BOOST_CHECK(image.load(exts[i], files[i]));
+    BOOST_CHECK(IsSame(expected, image));
+  }
+
+  utils::Size size;
+  BOOST_CHECK(!img::Image::readSize("png", tools::ByteArray::empty, size));
+  BOOST_CHECK(!img::Image::readSize("jpg", tools::toByteArray("not an image"), size));
+}
+
+// Page of wrong extension is decoded from what the failed decoder read
+// and the rest of the stream
+BOOST_AUTO_TEST_CASE(Recording_WrongExtension) {
+  const tools::ByteArray png = ReadTestFile("test_data/hor_800x600.png");
+  BOOST_REQUIRE(!png.isEmpty());
+  img::Image expected;
+  BOOST_REQUIRE(expected.load("png", png));
+
+  ChunkedStream stream(png, 100);
+  tools::RecordingInputStream recording(stream);
+  img::Image image;
+  BOOST_CHECK(!image.load("jpg", recording));
+
+  tools::ByteArray data = recording.recorded();
+  tools::append(data, tools::readAll(stream));
+  BOOST_CHECK_EQUAL(data.getSize(), png.getSize());
+  BOOST_CHECK(image.load("jpg", data));
+  BOOST_CHECK(IsSame(expected, image));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
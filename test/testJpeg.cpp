@@ -0,0 +1,215 @@
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "byteArray.h"
+#include "image.h"
+#include "testBenchmark.h"
+#include "common/decoders/imgDecoderFactory.h"
+
+#include "testJpg_jpg.h"
+
+namespace {
+tools::ByteArray TestJpg() {
+  return tools::ByteArray(get_testJpg_jpg_buf(), get_testJpg_jpg_size());
+}
+
+img::Image Decode(const img::DecodeOptions& options) {
+  img::Image image;
+  BOOST_CHECK(image.load("jpg", TestJpg(), options));
+  return image;
+}
+
+img::Image Decode(img::DecodeMode mode, size_t alignment) {
+  img::DecodeOptions options;
+  options.mode = mode;
+  options.alignment = alignment;
+  return Decode(options);
+}
+
+img::Image Decode(const utils::Size& target) {
+  img::DecodeOptions options;
+  options.targetSize = target;
+  return Decode(options);
+}
+
+bool IsSame(const img::Image& left, const img::Image& right) {
+  return left.width() == right.width() && left.height() == right.height() && left.depth() == right.depth() &&
+         img::dataSize(left) == img::dataSize(right) &&
+         0 == memcmp(left.data(), right.data(), img::dataSize(left));
+}
+
+// Decodes the same image with its own options again and again
+void DecodeRepeatedly(const img::DecodeOptions* options, const img::Image* expected, int count,
+                      std::atomic<int>* mismatches) {
+  const tools::ByteArray data = TestJpg();
+  for (int i = 0; i < count; ++i) {
+    img::Image image;
+    if (!img::DecoderFactory::getInstance().decode("jpg", data, image, *options) || !IsSame(*expected, image))
+      ++*mismatches;
+  }
+}
+}
+
+namespace test {
+// --log_level=test_suite --run_test=TestJpeg
+BOOST_AUTO_TEST_SUITE(TestJpeg)
+
+// Image is reduced by 1/2, 1/4 or 1/8 while it stays not smaller than target
+BOOST_AUTO_TEST_CASE(TargetSize) {
+  const img::Image full = Decode(utils::Size());
+  const unsigned width = full.width();
+  const unsigned height = full.height();
+  BOOST_REQUIRE(width >= 8 && height >= 8);
+
+  img::Image image = Decode(utils::Size(width / 4, height / 4));
+  BOOST_CHECK_EQUAL(image.width(), (width + 3) / 4);
+  BOOST_CHECK_EQUAL(image.height(), (height + 3) / 4);
+
+  image = Decode(utils::Size(width / 4 + 1, 0));
+  BOOST_CHECK_EQUAL(image.width(), (width + 1) / 2);
+
+  image = Decode(utils::Size(0, height / 8));
+  BOOST_CHECK_EQUAL(image.height(), (height + 7) / 8);
+
+  // Larger target than image keeps full size
+  image = Decode(utils::Size(width * 2, height * 2));
+  BOOST_CHECK_EQUAL(image.width(), width);
+  BOOST_CHECK_EQUAL(image.height(), height);
+
+  // Scale doesn't stay for the next image
+  image = Decode(utils::Size(width / 2, height / 2));
+  BOOST_CHECK_EQUAL(image.width(), (width + 1) / 2);
+  image = Decode(utils::Size());
+  BOOST_CHECK_EQUAL(image.width(), width);
+}
+
+// Rows decoded in place have the same pixels as converted ones
+BOOST_AUTO_TEST_CASE(Rows) {
+  const size_t alignments[] = {1, 4};
+  for (size_t a = 0; a < sizeof(alignments) / sizeof(alignments[0]); ++a) {
+    const img::Image bgr = Decode(img::DecodeAsIs, alignments[a]);
+    const img::Image rgba = Decode(img::DecodeIntoRgba, alignments[a]);
+    BOOST_REQUIRE_EQUAL(bgr.depth(), 3);
+    BOOST_REQUIRE_EQUAL(rgba.depth(), 4);
+    BOOST_REQUIRE_EQUAL(bgr.width(), rgba.width());
+    BOOST_REQUIRE_EQUAL(bgr.height(), rgba.height());
+
+    size_t mismatches = 0;
+    for (img::Image::SizeType y = 0; y < bgr.height(); ++y) {
+      const unsigned char* bgr_row = bgr.data() + y * bgr.scanline(true);
+      const unsigned char* rgba_row = rgba.data() + y * rgba.scanline(true);
+      for (img::Image::SizeType x = 0; x < bgr.width(); ++x) {
+        for (int c = 0; c < 3; ++c)
+          mismatches += bgr_row[x * 3 + c] != rgba_row[x * 4 + c];
+      }
+
+      // Alignment is filled with zeroes
+      for (size_t i = bgr.scanline(false); i < bgr.scanline(true); ++i)
+        mismatches += bgr_row[i] != 0;
+    }
+    BOOST_CHECK_EQUAL(mismatches, 0);
+  }
+
+  // Reduced image is decoded in place too
+  img::DecodeOptions options;
+  options.alignment = 4;
+  options.targetSize = utils::Size(1, 1);
+  const img::Image reduced = Decode(options);
+  BOOST_CHECK_EQUAL(reduced.depth(), 3);
+  BOOST_CHECK_EQUAL(reduced.scanline(true) % 4, 0);
+}
+
+// Gray image is luma which libjpeg decodes without chroma
+BOOST_AUTO_TEST_CASE(Gray) {
+  const img::Image bgr = Decode(img::DecodeAsIs, 1);
+  const img::Image gray = Decode(img::DecodeIntoGray, 4);
+  BOOST_REQUIRE_EQUAL(gray.depth(), 1);
+  BOOST_REQUIRE_EQUAL(gray.width(), bgr.width());
+  BOOST_REQUIRE_EQUAL(gray.height(), bgr.height());
+
+  // Luma differs from the one of converted colors by rounding, except
+  // clipped saturated colors
+  int total_difference = 0;
+  for (img::Image::SizeType y = 0; y < gray.height(); ++y) {
+    const unsigned char* bgr_row = bgr.data() + y * bgr.scanline(true);
+    const unsigned char* gray_row = gray.data() + y * gray.scanline(true);
+    for (img::Image::SizeType x = 0; x < gray.width(); ++x) {
+      const unsigned char* pixel = bgr_row + x * 3;
+      const int luma = (299 * pixel[2] + 587 * pixel[1] + 114 * pixel[0] + 500) / 1000;
+      total_difference += std::abs(luma - gray_row[x]);
+    }
+  }
+  BOOST_CHECK_LE(total_difference, static_cast<int>(gray.width() * gray.height()));
+
+  img::DecodeOptions options;
+  options.mode = img::DecodeIntoGray;
+  BENCHMARK("JPEG decoding into gray, 1000 times") {
+    for (int i = 0; i < 1000; ++i) {
+      img::Image image;
+      BOOST_REQUIRE(image.load("jpg", TestJpg(), options));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Decode_Benchmark) {
+  BENCHMARK("JPEG decoding, 1000 times") {
+    for (int i = 0; i < 1000; ++i) {
+      img::Image image;
+      BOOST_REQUIRE(image.load("jpg", TestJpg()));
+    }
+  }
+}
+
+// Part of the image is kept, the one outside of image fails
+BOOST_AUTO_TEST_CASE(Region) {
+  const img::Image full = Decode(img::DecodeAsIs, 1);
+  BOOST_REQUIRE(full.width() > 4 && full.height() > 4);
+
+  img::DecodeOptions options;
+  options.alignment = 4;
+  options.region = utils::Rect(1, 2, 3, full.height());
+  const img::Image part = Decode(options);
+  BOOST_REQUIRE_EQUAL(part.width(), 3);
+  BOOST_REQUIRE_EQUAL(part.height(), full.height() - 2);
+  BOOST_CHECK_EQUAL(part.alignment(), 4);
+  for (img::Image::SizeType y = 0; y < part.height(); ++y) {
+    BOOST_CHECK(0 == memcmp(part.data() + y * part.scanline(true),
+                            full.data() + (y + 2) * full.scanline(true) + 3, part.scanline(false)));
+  }
+
+  options.region = utils::Rect(full.width(), 0, 1, 1);
+  img::Image image;
+  BOOST_CHECK(!image.load("jpg", TestJpg(), options));
+  BOOST_CHECK(image.empty());
+}
+
+// Every thread decodes with its own options at the same time
+BOOST_AUTO_TEST_CASE(Parallel) {
+  std::vector<img::DecodeOptions> options(4);
+  options[1].mode = img::DecodeIntoGray;
+  options[2].mode = img::DecodeIntoRgba;
+  options[2].alignment = 4;
+  options[3].targetSize = utils::Size(1, 1);
+
+  std::vector<img::Image> expected;
+  for (size_t i = 0; i < options.size(); ++i)
+    expected.push_back(Decode(options[i]));
+
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < options.size(); ++i)
+    threads.push_back(std::thread(DecodeRepeatedly, &options[i], &expected[i], 200, &mismatches));
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  BOOST_CHECK_EQUAL(mismatches, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
@@ -0,0 +1,4 @@
+// local stub, not tracked
+static unsigned char d[]={255,216,255,224,0,16,74,70,73,70,0,1,1,0,0,1,0,1,0,0,255,219,0,67,0,8,6,6,7,6,5,8,7,7,7,9,9,8,10,12,20,13,12,11,11,12,25,18,19,15,20,29,26,31,30,29,26,28,28,32,36,46,39,32,34,44,35,28,28,40,55,41,44,48,49,52,52,52,31,39,57,61,56,50,60,46,51,52,50,255,219,0,67,1,9,9,9,12,11,12,24,13,13,24,50,33,28,33,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,50,255,192,0,17,8,0,48,0,64,3,1,34,0,2,17,1,3,17,1,255,196,0,31,0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0,0,1,2,3,4,5,6,7,8,9,10,11,255,196,0,181,16,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,125,1,2,3,0,4,17,5,18,33,49,65,6,19,81,97,7,34,113,20,50,129,145,161,8,35,66,177,193,21,82,209,240,36,51,98,114,130,9,10,22,23,24,25,26,37,38,39,40,41,42,52,53,54,55,56,57,58,67,68,69,70,71,72,73,74,83,84,85,86,87,88,89,90,99,100,101,102,103,104,105,106,115,116,117,118,119,120,121,122,131,132,133,134,135,136,137,138,146,147,148,149,150,151,152,153,154,162,163,164,165,166,167,168,169,170,178,179,180,181,182,183,184,185,186,194,195,196,197,198,199,200,201,202,210,211,212,213,214,215,216,217,218,225,226,227,228,229,230,231,232,233,234,241,242,243,244,245,246,247,248,249,250,255,196,0,31,1,0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,1,2,3,4,5,6,7,8,9,10,11,255,196,0,181,17,0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,119,0,1,2,3,17,4,5,33,49,6,18,65,81,7,97,113,19,34,50,129,8,20,66,145,161,177,193,9,35,51,82,240,21,98,114,209,10,22,36,52,225,37,241,23,24,25,26,38,39,40,41,42,53,54,55,56,57,58,67,68,69,70,71,72,73,74,83,84,85,86,87,88,89,90,99,100,101,102,103,104,105,106,115,116,117,118,119,120,121,122,130,131,132,133,134,135,136,137,138,146,147,148,149,150,151,152,153,154,162,163,164,165,166,167,168,169,170,178,179,180,181,182,183,184,185,186,194,195,196,197,198,199,200,201,202,210,211,212,213,214,215,216,217,218,226,227,228,229,230,231,232,233,234,242,243,244,245,246,247,248,249,250,255,218,0,12,3,1,0,2,17,3,17,0,63,0,230,126,31,219,127,170,227,210,186,79,139,18,171,92,248,99,79,86,249,209,38,157,215,29,152,162,169,207,252,5,255,0,206,42,159,195,251,111,245,92,122,81,241,26,97,117,241,38,218,221,67,129,105,99,20,68,30,155,137,103,200,252,28,15,194,156,183,94,191,163,8,94,210,107,162,255,0,37,250,216,237,252,5,0,68,70,35,128,51,94,93,224,163,45,237,227,93,206,197,230,158,67,36,140,73,36,179,28,147,147,207,83,94,144,172,44,190,30,235,183,5,214,50,186,116,193,89,136,3,113,66,23,175,124,145,199,122,226,126,31,219,127,170,227,210,133,173,71,228,151,227,127,242,252,5,180,63,175,235,169,179,241,94,105,35,211,60,51,167,169,253,212,211,77,59,142,62,242,42,42,251,255,0,203,70,173,255,0,135,246,223,234,184,244,174,83,226,131,73,39,141,244,123,50,196,195,14,156,178,42,228,224,51,72,224,156,116,232,171,249,87,91,163,202,250,95,132,181,75,248,216,171,219,88,205,50,176,0,144,85,9,28,30,15,35,189,74,118,140,164,173,125,127,13,63,77,71,110,105,40,220,243,79,13,76,218,174,191,121,168,182,210,215,119,82,78,118,130,6,93,139,113,158,123,247,174,187,226,156,177,199,225,61,11,79,57,243,103,190,243,212,113,141,169,25,83,239,255,0,45,22,185,175,135,246,223,234,184,244,173,159,138,179,172,186,255,0,135,116,208,191,53,189,171,220,19,158,162,70,10,56,255,0,182,71,243,166,227,101,24,175,47,195,254,26,223,48,191,51,114,183,245,228,95,248,127,109,254,171,143,74,230,181,153,134,165,241,79,91,156,40,27,46,68,28,54,127,213,170,199,255,0,178,116,237,93,239,195,251,111,245,92,122,87,155,120,106,102,213,117,251,205,69,182,150,187,186,146,115,180,16,50,236,91,140,243,223,189,83,248,215,207,244,18,183,35,245,95,169,221,248,205,210,211,225,61,244,101,202,61,204,144,66,152,7,230,62,98,177,28,127,178,173,214,179,126,31,219,127,170,227,210,165,248,167,44,113,248,79,66,211,206,124,217,239,188,245,28,99,106,70,84,251,255,0,203,69,173,63,135,246,223,234,184,244,165,13,229,235,250,45,191,173,238,18,217,28,119,138,138,221,252,89,213,138,58,186,70,97,136,21,32,224,172,72,24,113,232,219,171,175,241,27,189,151,194,125,102,68,44,172,241,199,23,202,196,28,60,136,164,125,48,79,29,250,87,9,96,233,168,248,219,89,189,137,203,197,62,161,60,145,177,207,42,100,37,122,243,211,21,214,252,77,117,135,192,58,101,174,83,204,159,80,67,180,158,74,170,57,36,15,98,87,243,168,189,233,175,59,126,63,230,105,170,171,173,238,190,123,109,249,25,255,0,15,237,191,213,113,233,85,60,119,112,111,126,41,205,1,80,5,149,188,22,224,129,215,43,230,115,207,172,132,118,233,93,31,195,251,111,245,92,122,87,33,115,52,154,151,196,157,118,226,94,72,190,146,16,113,252,49,157,139,219,209,69,84,181,156,83,243,127,167,234,102,180,139,61,7,71,149,244,191,9,106,151,241,177,87,182,177,154,101,96,1,32,170,18,56,60,30,71,122,243,223,135,246,223,234,184,244,174,219,196,110,246,95,9,245,153,16,178,179,199,28,95,43,16,112,242,34,145,244,193,60,119,233,88,63,15,237,191,213,113,233,77,91,157,181,229,253,126,63,136,219,247,18,243,127,160,191,21,103,89,117,255,0,14,233,161,126,107,123,87,184,39,61,68,140,20,113,255,0,108,143,231,93,103,132,230,139,75,210,103,212,102,7,202,181,129,231,124,99,238,170,150,61,113,216,87,15,227,187,131,123,241,78,104,10,128,44,173,224,183,4,14,185,95,51,158,125,100,35,183,74,235,53,43,133,210,254,24,107,183,12,155,131,217,155,124,103,28,202,68,99,177,254,255,0,255,0,171,173,66,254,27,183,158,223,61,191,65,217,57,165,167,79,235,252,207,62,248,127,109,254,171,143,74,233,62,44,74,173,115,225,141,61,91,231,68,154,119,92,118,98,138,167,63,240,23,255,0,56,170,127,15,237,191,213,113,233,71,196,105,133,215,196,155,107,117,14,5,165,140,81,16,122,110,37,159,35,240,112,63,10,185,110,189,127,70,40,94,210,107,162,255,0,37,250,216,237,252,5,0,68,70,35,128,51,94,93,224,163,45,237,227,93,206,197,230,158,67,36,140,73,36,179,28,147,147,207,83,94,144,172,44,190,30,235,183,5,214,50,186,116,193,89,136,3,113,66,23,175,124,145,199,122,226,126,31,219,127,170,227,210,133,173,71,228,151,227,127,242,252,5,180,63,175,235,169,255,217};
+unsigned int get_testJpg_jpg_size(){return sizeof(d);}
+void* get_testJpg_jpg_buf(){return d;}
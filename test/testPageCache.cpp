@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+
+#include "pageCache.h"
+#include "image.h"
+
+namespace test {
+// --log_level=test_suite --run_test=TestPageCache
+BOOST_AUTO_TEST_SUITE(TestPageCache)
+
+class TestBookCache : public manga::IBookCache {
+public:
+  explicit TestBookCache(int value = 0)
+    : value_(value) {}
+
+  int value() const {
+    return value_;
+  }
+
+  virtual IBookCache* clone() {
+    return new TestBookCache;
+  }
+
+  virtual IBookCache* copy() const {
+    return new TestBookCache(value_);
+  }
+
+  virtual void swap(IBookCache* other) {
+    std::swap(value_, static_cast<TestBookCache*>(other)->value_);
+  }
+
+  virtual bool onLoaded(img::Image& image) {
+    value_ = image.width();
+    return true;
+  }
+
+  virtual size_t memoryUsage() const {
+    return 10;
+  }
+
+private:
+  int value_;
+};
+
+manga::PageCache::Key PageKey(const std::string& file, time_t modified = 0, const std::string& decoding = "") {
+  return manga::PageCache::Key(manga::PathToFile(fs::FilePath("/path/to/archive.zip", false), fs::FilePath(file, false)),
+                               modified, decoding);
+}
+
+// 100 bytes each
+img::Image PageImage(unsigned char fill) {
+  img::Image image(10, 10, 1);
+  memset(image.data(), fill, img::dataSize(image));
+  return image;
+}
+
+BOOST_AUTO_TEST_CASE(FindInserted) {
+  manga::PageCache cache(1000);
+
+  img::Image image;
+  std::auto_ptr<manga::IBookCache> book_cache;
+  BOOST_CHECK(!cache.find(PageKey("page1.jpg"), image, book_cache));
+
+  cache.insert(PageKey("page1.jpg"), PageImage(1), 0);
+  BOOST_CHECK_EQUAL(cache.size(), 100U);
+
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg"), image, book_cache));
+  BOOST_CHECK_EQUAL(image.width(), 10U);
+  BOOST_CHECK_EQUAL(image.data()[0], 1);
+  BOOST_CHECK(!book_cache.get());
+
+  BOOST_CHECK(!cache.find(manga::PageCache::Key(manga::PathToFile(fs::FilePath("/path/to/archive.zip/page1.jpg", false)), 0, ""),
+                          image, book_cache));
+
+  const manga::PageCache::Statistics stats = cache.statistics();
+  BOOST_CHECK_EQUAL(stats.hits, 1U);
+  BOOST_CHECK_EQUAL(stats.misses, 2U);
+  BOOST_CHECK_EQUAL(stats.evictions, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(CachedResult) {
+  manga::PageCache cache(1000);
+
+  img::Image image = PageImage(1);
+  TestBookCache loaded;
+  loaded.onLoaded(image);
+  cache.insert(PageKey("page1.jpg"), image, &loaded);
+  BOOST_CHECK_EQUAL(cache.size(), 110U);
+
+  std::auto_ptr<manga::IBookCache> book_cache(new TestBookCache);
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg"), image, book_cache));
+  BOOST_CHECK_EQUAL(static_cast<TestBookCache*>(book_cache.get())->value(), 10);
+
+  // Page without result doesn't satisfy request with cache
+  cache.insert(PageKey("page2.jpg"), image, 0);
+  BOOST_CHECK(!cache.find(PageKey("page2.jpg"), image, book_cache));
+}
+
+// Modified page and page decoded in other way are not the cached one
+BOOST_AUTO_TEST_CASE(OtherVersions) {
+  manga::PageCache cache(1000);
+
+  img::Image image;
+  std::auto_ptr<manga::IBookCache> book_cache;
+  cache.insert(PageKey("page1.jpg", 10, "gray"), PageImage(1), 0);
+  BOOST_CHECK(!cache.find(PageKey("page1.jpg", 11, "gray"), image, book_cache));
+  BOOST_CHECK(!cache.find(PageKey("page1.jpg", 10, "rgb"), image, book_cache));
+  BOOST_CHECK(cache.find(PageKey("page1.jpg", 10, "gray"), image, book_cache));
+
+  cache.insert(PageKey("page1.jpg", 10, "rgb"), PageImage(2), 0);
+  BOOST_CHECK_EQUAL(cache.size(), 200U);
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg", 10, "gray"), image, book_cache));
+  BOOST_CHECK_EQUAL(image.data()[0], 1);
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg", 10, "rgb"), image, book_cache));
+  BOOST_CHECK_EQUAL(image.data()[0], 2);
+}
+
+BOOST_AUTO_TEST_CASE(EvictLeastRecentlyUsed) {
+  manga::PageCache cache(300);
+
+  cache.insert(PageKey("page1.jpg"), PageImage(1), 0);
+  cache.insert(PageKey("page2.jpg"), PageImage(2), 0);
+  cache.insert(PageKey("page3.jpg"), PageImage(3), 0);
+
+  img::Image image;
+  std::auto_ptr<manga::IBookCache> book_cache;
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg"), image, book_cache));
+
+  cache.insert(PageKey("page4.jpg"), PageImage(4), 0);
+  BOOST_CHECK_EQUAL(cache.size(), 300U);
+  BOOST_CHECK_EQUAL(cache.statistics().evictions, 1U);
+
+  BOOST_CHECK(!cache.find(PageKey("page2.jpg"), image, book_cache));
+  BOOST_CHECK(cache.find(PageKey("page1.jpg"), image, book_cache));
+  BOOST_CHECK(cache.find(PageKey("page3.jpg"), image, book_cache));
+  BOOST_CHECK(cache.find(PageKey("page4.jpg"), image, book_cache));
+
+  cache.setLimit(100);
+  BOOST_CHECK_EQUAL(cache.size(), 100U);
+  BOOST_CHECK_EQUAL(cache.statistics().evictions, 3U);
+  BOOST_CHECK(cache.find(PageKey("page4.jpg"), image, book_cache));
+
+  // Larger than limit
+  cache.insert(PageKey("page5.jpg"), img::Image(20, 20, 1), 0);
+  BOOST_CHECK(!cache.find(PageKey("page5.jpg"), image, book_cache));
+  BOOST_CHECK(cache.find(PageKey("page4.jpg"), image, book_cache));
+}
+
+BOOST_AUTO_TEST_CASE(Disabled) {
+  manga::PageCache cache;
+
+  cache.insert(PageKey("page1.jpg"), PageImage(1), 0);
+
+  img::Image image;
+  std::auto_ptr<manga::IBookCache> book_cache;
+  BOOST_CHECK(!cache.find(PageKey("page1.jpg"), image, book_cache));
+  BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(CachedImageIsNotChanged) {
+  manga::PageCache cache(1000);
+
+  cache.insert(PageKey("page1.jpg"), PageImage(1), 0);
+
+  img::Image image;
+  std::auto_ptr<manga::IBookCache> book_cache;
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg"), image, book_cache));
+  image.data()[0] = 2;
+
+  img::Image other;
+  BOOST_REQUIRE(cache.find(PageKey("page1.jpg"), other, book_cache));
+  BOOST_CHECK_EQUAL(other.data()[0], 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}